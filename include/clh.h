@@ -0,0 +1,190 @@
+/*
+ * File: clh.h
+ *
+ * CLH queue lock: every waiter spins on the node of its predecessor,
+ * and takes that node over when it releases the lock (the node it came
+ * with is left to its successor). A thread gets the nodes it enqueues
+ * from a thread-local free list, so it can hold any number of CLH locks
+ * at once; the lock remembers the node of its holder for the release.
+ *
+ * The tail is a (node, sequence) pair swapped with a 16-byte CAS
+ * (cmpxchg16b, build with -mcx16): every enqueue bumps the sequence, so
+ * that trylock's CAS only succeeds if nobody enqueued since it saw the
+ * tail node free, even if that node was recycled and enqueued again.
+ */
+
+#ifndef _CLH_H_
+#define _CLH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#if !defined(CACHE_LINE_SIZE)
+#  define CACHE_LINE_SIZE 64
+#endif
+
+typedef struct clh_qnode
+{
+  volatile uint64_t locked;	/* the owner holds or waits for the lock */
+  struct clh_qnode* next;	/* in the free list of a thread */
+  uint8_t padding[CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(struct clh_qnode*)];
+} clh_qnode_t;
+
+typedef union clh_tail
+{
+  struct
+  {
+    clh_qnode_t* node;
+    uint64_t seq;		/* enqueues so far */
+  };
+  unsigned __int128 word;
+} __attribute__ ((aligned(16))) clh_tail_t;
+
+typedef struct clh_lock
+{
+  volatile clh_tail_t tail;
+  clh_qnode_t* holder;		/* node of the holder */
+  clh_qnode_t* pred;		/* node the holder takes over at release */
+} clh_lock_t;
+
+extern __thread clh_qnode_t* __clh_free;
+
+static inline clh_qnode_t*
+clh_qnode_new()
+{
+  clh_qnode_t* n;
+  if (posix_memalign((void**) &n, CACHE_LINE_SIZE, sizeof(clh_qnode_t)) != 0)
+    {
+      fprintf(stderr, "clh: out of memory\n");
+      abort();
+    }
+  n->locked = 0;
+  n->next = NULL;
+  return n;
+}
+
+static inline clh_qnode_t*
+clh_qnode_get()
+{
+  clh_qnode_t* n = __clh_free;
+  if (n == NULL)
+    {
+      return clh_qnode_new();
+    }
+  __clh_free = n->next;
+  return n;
+}
+
+static inline void
+clh_qnode_put(clh_qnode_t* n)
+{
+  n->next = __clh_free;
+  __clh_free = n;
+}
+
+/* may be torn: the CAS then fails */
+static inline clh_tail_t
+clh_tail_read(clh_lock_t* lock)
+{
+  clh_tail_t t;
+  t.seq = lock->tail.seq;
+  t.node = lock->tail.node;
+  return t;
+}
+
+/* enqueues me if the tail is still t */
+static inline int
+clh_tail_cas(clh_lock_t* lock, clh_tail_t t, clh_qnode_t* me)
+{
+  clh_tail_t n;
+  n.node = me;
+  n.seq = t.seq + 1;
+  return __sync_bool_compare_and_swap(&lock->tail.word, t.word, n.word);
+}
+
+static inline int
+clh_lock_init(clh_lock_t* lock)
+{
+  lock->tail.node = clh_qnode_new();
+  lock->tail.seq = 0;
+  lock->holder = NULL;
+  lock->pred = NULL;
+  asm volatile ("mfence");
+  return 0;
+}
+
+static inline int
+clh_lock_destroy(clh_lock_t* lock)
+{
+  free(lock->tail.node);		/* the only node left */
+  lock->tail.node = NULL;
+  return 0;
+}
+
+static inline int
+clh_lock_lock(clh_lock_t* lock)
+{
+  clh_qnode_t* me = clh_qnode_get();
+  me->locked = 1;
+  clh_tail_t t;
+  do
+    {
+      t = clh_tail_read(lock);
+    }
+  while (!clh_tail_cas(lock, t, me));
+  clh_qnode_t* pred = t.node;
+  while (pred->locked)
+    {
+      asm volatile ("pause");
+    }
+  lock->holder = me;
+  lock->pred = pred;
+  return 0;
+}
+
+/* returns 1 if the lock was free and is now held, never waits. A free
+   tail node stays free until someone enqueues behind it, which changes
+   the sequence and fails the CAS */
+static inline int
+clh_lock_trylock(clh_lock_t* lock)
+{
+  clh_tail_t t = clh_tail_read(lock);
+  if (t.node->locked)
+    {
+      return 0;
+    }
+
+  clh_qnode_t* me = clh_qnode_get();
+  me->locked = 1;
+  if (!clh_tail_cas(lock, t, me))
+    {
+      me->locked = 0;
+      clh_qnode_put(me);
+      return 0;
+    }
+  lock->holder = me;
+  lock->pred = t.node;
+  return 1;
+}
+
+static inline int
+clh_lock_unlock(clh_lock_t* lock)
+{
+  clh_qnode_t* me = lock->holder;
+  clh_qnode_t* pred = lock->pred;
+  asm volatile ("" ::: "memory");
+  me->locked = 0;
+  clh_qnode_put(pred);
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _CLH_H_ */
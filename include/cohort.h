@@ -0,0 +1,259 @@
+/*
+ * File: cohort.h
+ *
+ * C-TKT-MCS cohort lock (Dice, Marathe and Shavit, "Lock Cohorting",
+ * PPoPP 2012): a global ticket lock plus one MCS queue per NUMA node.
+ * A thread first gets the queue of its node, then the global lock;
+ * at release, if a thread of the same node is queued behind it, the
+ * holder passes it the global lock along with the local one, so the
+ * lock (and the data it protects) stays in the caches of one socket.
+ * After COHORT_MAX_PASSES local handoffs in a row, the global lock is
+ * released, so that the other nodes are not starved.
+ *
+ * The node of a thread is read once (getcpu()) and cached, so threads
+ * should be pinned; a wrong node only costs performance.
+ */
+
+#ifndef _COHORT_H_
+#define _COHORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#if !defined(CACHE_LINE_SIZE)
+#  define CACHE_LINE_SIZE 64
+#endif
+
+#define COHORT_MAX_NODES  8	/* NUMA nodes (higher ones share queues) */
+#define COHORT_MAX_PASSES 64	/* local handoffs before releasing the global lock */
+
+typedef struct cohort_qnode
+{
+  struct cohort_qnode* volatile next;
+  volatile uint32_t waiting;
+  volatile uint32_t global;	/* handed the global lock with the local one */
+  struct cohort_qnode* free;	/* in the free list of a thread */
+  uint8_t padding[CACHE_LINE_SIZE - 3 * sizeof(void*)];
+} cohort_qnode_t;
+
+typedef struct cohort_local
+{
+  cohort_qnode_t* volatile tail;
+  uint32_t passes;		/* local handoffs of the global lock in a row */
+  uint8_t padding[CACHE_LINE_SIZE - sizeof(void*) - sizeof(uint32_t)];
+} cohort_local_t;
+
+typedef struct cohort_lock
+{
+  volatile uint32_t ticket;
+  volatile uint32_t curr;
+  cohort_qnode_t* holder;	/* node of the holder */
+  uint32_t node;		/* NUMA node of the holder */
+  uint8_t padding[CACHE_LINE_SIZE - 2 * sizeof(uint32_t) - sizeof(void*) - sizeof(uint32_t)];
+  cohort_local_t local[COHORT_MAX_NODES];
+} __attribute__ ((aligned(CACHE_LINE_SIZE))) cohort_lock_t;
+
+extern __thread cohort_qnode_t* __cohort_free;
+extern __thread int32_t __cohort_node;
+
+/* NUMA node of the calling thread (when it first asked) */
+static inline uint32_t
+cohort_numa_node()
+{
+  if (__builtin_expect(__cohort_node < 0, 0))
+    {
+      unsigned cpu = 0, node = 0;
+      if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+	{
+	  node = 0;
+	}
+      __cohort_node = node % COHORT_MAX_NODES;
+    }
+  return __cohort_node;
+}
+
+static inline cohort_qnode_t*
+cohort_qnode_get()
+{
+  cohort_qnode_t* n = __cohort_free;
+  if (n == NULL)
+    {
+      if (posix_memalign((void**) &n, CACHE_LINE_SIZE, sizeof(cohort_qnode_t)) != 0)
+	{
+	  fprintf(stderr, "cohort: out of memory\n");
+	  abort();
+	}
+      return n;
+    }
+  __cohort_free = n->free;
+  return n;
+}
+
+static inline void
+cohort_qnode_put(cohort_qnode_t* n)
+{
+  n->free = __cohort_free;
+  __cohort_free = n;
+}
+
+static inline int
+cohort_lock_init(cohort_lock_t* lock)
+{
+  lock->ticket = lock->curr = 0;
+  lock->holder = NULL;
+  int i;
+  for (i = 0; i < COHORT_MAX_NODES; i++)
+    {
+      lock->local[i].tail = NULL;
+      lock->local[i].passes = 0;
+    }
+  asm volatile ("mfence");
+  return 0;
+}
+
+static inline int
+cohort_lock_destroy(cohort_lock_t* lock)
+{
+  return 0;
+}
+
+/* the global ticket lock */
+static inline void
+cohort_global_lock(cohort_lock_t* lock)
+{
+  uint32_t ticket = __sync_fetch_and_add(&lock->ticket, 1);
+  while (ticket != lock->curr)
+    {
+      asm volatile ("pause");
+    }
+}
+
+static inline int
+cohort_global_trylock(cohort_lock_t* lock)
+{
+  uint32_t t = lock->curr;
+  return lock->ticket == t && __sync_bool_compare_and_swap(&lock->ticket, t, t + 1);
+}
+
+static inline void
+cohort_global_unlock(cohort_lock_t* lock)
+{
+  asm volatile ("" ::: "memory");
+  lock->curr++;
+}
+
+/* hands the local lock (and the global one, if global) to the
+   successor of n, or frees the local queue if n has none */
+static inline void
+cohort_local_unlock(cohort_local_t* local, cohort_qnode_t* n, uint32_t global)
+{
+  cohort_qnode_t* succ = n->next;
+  if (succ == NULL)
+    {
+      if (__sync_bool_compare_and_swap(&local->tail, n, NULL))
+	{
+	  return;
+	}
+      while ((succ = n->next) == NULL)
+	{
+	  asm volatile ("pause");
+	}
+    }
+  succ->global = global;
+  asm volatile ("" ::: "memory");
+  succ->waiting = 0;
+}
+
+static inline int
+cohort_lock_lock(cohort_lock_t* lock)
+{
+  uint32_t node = cohort_numa_node();
+  cohort_local_t* local = &lock->local[node];
+  cohort_qnode_t* me = cohort_qnode_get();
+  me->next = NULL;
+  me->waiting = 1;
+  me->global = 0;
+
+  cohort_qnode_t* pred = __sync_lock_test_and_set(&local->tail, me);
+  if (pred != NULL)
+    {
+      pred->next = me;
+      while (me->waiting)
+	{
+	  asm volatile ("pause");
+	}
+    }
+  if (!me->global)
+    {
+      cohort_global_lock(lock);
+    }
+  lock->holder = me;
+  lock->node = node;
+  return 0;
+}
+
+/* returns 1 if the lock was free and is now held */
+static inline int
+cohort_lock_trylock(cohort_lock_t* lock)
+{
+  uint32_t node = cohort_numa_node();
+  cohort_local_t* local = &lock->local[node];
+  if (local->tail != NULL)
+    {
+      return 0;
+    }
+
+  cohort_qnode_t* me = cohort_qnode_get();
+  me->next = NULL;
+  me->waiting = 0;
+  me->global = 0;
+  if (!__sync_bool_compare_and_swap(&local->tail, NULL, me))
+    {
+      cohort_qnode_put(me);
+      return 0;
+    }
+  if (!cohort_global_trylock(lock))
+    {
+      cohort_local_unlock(local, me, 0);
+      cohort_qnode_put(me);
+      return 0;
+    }
+  local->passes = 0;
+  lock->holder = me;
+  lock->node = node;
+  return 1;
+}
+
+static inline int
+cohort_lock_unlock(cohort_lock_t* lock)
+{
+  cohort_qnode_t* me = lock->holder;
+  cohort_local_t* local = &lock->local[lock->node];
+  if (me->next != NULL && local->passes < COHORT_MAX_PASSES)
+    {
+      /* a thread of our node is waiting: it gets the global lock too */
+      local->passes++;
+      cohort_local_unlock(local, me, 1);
+    }
+  else
+    {
+      local->passes = 0;
+      cohort_global_unlock(lock);
+      cohort_local_unlock(local, me, 0);
+    }
+  cohort_qnode_put(me);
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _COHORT_H_ */
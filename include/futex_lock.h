@@ -0,0 +1,162 @@
+/*
+ * File: futex_lock.h
+ *
+ * Spin-then-park waiting: a waiter spins for a bounded number of cycles
+ * (the lock is usually handed over quickly), then sleeps in the kernel
+ * with futex() until it is woken. When threads outnumber cores, the
+ * holder may be preempted: spinning then only burns the quantum the
+ * holder needs to finish, while a parked waiter gives the core back.
+ *
+ * A futex word is 0 when released, 1 when held and 2 when held with
+ * (possibly) sleeping waiters, so that releases only enter the kernel
+ * when someone sleeps (Drepper, "Futexes Are Tricky"). futex_lock_t is
+ * such a word used as a mutex; futex_wait_zero() and futex_clear() use
+ * it as a flag that waiters wait on (e.g., the MCS queue nodes).
+ */
+
+#ifndef _FUTEX_LOCK_H_
+#define _FUTEX_LOCK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+  /* cycles a waiter spins before it parks (0: never parks) */
+#if !defined(FUTEX_SPIN_CYCLES)
+#  define FUTEX_SPIN_CYCLES (1UL << 14)
+#endif
+
+#define FUTEX_FREE 0
+#define FUTEX_HELD 1
+#define FUTEX_SLEEPERS 2	/* held, with sleepers */
+
+typedef volatile uint32_t futex_lock_t;
+
+static inline uint64_t
+futex_ticks()
+{
+  unsigned hi, lo;
+  asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* sleeps while *addr == val (or until timeout, if not NULL) */
+static inline long
+futex_wait(volatile uint32_t* addr, uint32_t val, const struct timespec* timeout)
+{
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static inline long
+futex_wake(volatile uint32_t* addr, int n)
+{
+  return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* spins while *addr != 0, for at most spin cycles (forever with 0);
+   returns 1 if it became 0 */
+static inline int
+futex_spin(volatile uint32_t* addr, uint64_t spin)
+{
+  uint64_t start = futex_ticks();
+  while (*addr != 0)
+    {
+      if (spin != 0 && futex_ticks() - start > spin)
+	{
+	  return 0;
+	}
+      asm volatile ("pause");
+    }
+  return 1;
+}
+
+/* waits for the flag at addr (FUTEX_HELD or FUTEX_SLEEPERS) to be cleared
+   with futex_clear() */
+static inline void
+futex_wait_zero(volatile uint32_t* addr, uint64_t spin)
+{
+  if (futex_spin(addr, spin))
+    {
+      return;
+    }
+  uint32_t v;
+  while ((v = *addr) != 0)
+    {
+      if (v == FUTEX_SLEEPERS || __sync_bool_compare_and_swap(addr, FUTEX_HELD, FUTEX_SLEEPERS))
+	{
+	  futex_wait(addr, FUTEX_SLEEPERS, NULL);
+	}
+    }
+}
+
+static inline void
+futex_clear(volatile uint32_t* addr)
+{
+  if (__sync_lock_test_and_set(addr, FUTEX_FREE) == FUTEX_SLEEPERS)
+    {
+      futex_wake(addr, INT_MAX);
+    }
+}
+
+static inline void
+futex_lock_init(futex_lock_t* l)
+{
+  *l = FUTEX_FREE;
+}
+
+static inline uint32_t
+futex_lock_lock(futex_lock_t* l)
+{
+  if (__sync_val_compare_and_swap(l, FUTEX_FREE, FUTEX_HELD) == FUTEX_FREE)
+    {
+      return 0;
+    }
+
+  uint64_t start = futex_ticks();
+  while (FUTEX_SPIN_CYCLES == 0 || futex_ticks() - start < FUTEX_SPIN_CYCLES)
+    {
+      if (*l == FUTEX_FREE && __sync_val_compare_and_swap(l, FUTEX_FREE, FUTEX_HELD) == FUTEX_FREE)
+	{
+	  return 0;
+	}
+      asm volatile ("pause");
+    }
+
+  /* from now on, we may sleep: whoever releases the lock wakes one
+     sleeper, and the lock stays marked as having sleepers while we
+     hold it since we cannot know whether others still sleep */
+  while (__sync_lock_test_and_set(l, FUTEX_SLEEPERS) != FUTEX_FREE)
+    {
+      futex_wait(l, FUTEX_SLEEPERS, NULL);
+    }
+  return 0;
+}
+
+static inline uint32_t
+futex_lock_trylock(futex_lock_t* l)
+{
+  return __sync_val_compare_and_swap(l, FUTEX_FREE, FUTEX_HELD) == FUTEX_FREE;
+}
+
+static inline uint32_t
+futex_lock_unlock(futex_lock_t* l)
+{
+  if (__sync_lock_test_and_set(l, FUTEX_FREE) == FUTEX_SLEEPERS)
+    {
+      futex_wake(l, 1);
+    }
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _FUTEX_LOCK_H_ */
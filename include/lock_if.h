@@ -25,6 +25,14 @@
 
 #include <stdint.h>
 
+/* The lock family is selected at compile time (e.g., -DCOHORT):
+ * MUTEX, SPIN, TAS, TTAS, TICKET, MCS, CLH, COHORT (C-TKT-MCS, a
+ * NUMA-aware cohort lock), or FUTEX (spins, then sleeps in the kernel).
+ * For every family, TRYLOCK() returns nonzero if it acquired the lock,
+ * 0 if the lock was held. The MCS waiters also park after spinning for
+ * FUTEX_SPIN_CYCLES (see futex_lock.h).
+ */
+
 #if !defined(COMPILER_BARRIER)
 #  define COMPILER_BARRIER() asm volatile ("" ::: "memory")
 #endif
@@ -43,7 +51,7 @@ typedef pthread_mutex_t ptlock_t;
 #  define INIT_LOCK(lock)				pthread_mutex_init((pthread_mutex_t *) lock, NULL)
 #  define DESTROY_LOCK(lock)			        pthread_mutex_destroy((pthread_mutex_t *) lock)
 #  define LOCK(lock)					pthread_mutex_lock((pthread_mutex_t *) lock)
-#  define TRYLOCK(lock)					pthread_mutex_trylock((pthread_mutex_t *) lock)
+#  define TRYLOCK(lock)					(pthread_mutex_trylock((pthread_mutex_t *) lock) == 0)
 #  define UNLOCK(lock)					pthread_mutex_unlock((pthread_mutex_t *) lock)
 #elif defined(SPIN)		/* pthread spinlock */
 typedef pthread_spinlock_t ptlock_t;
@@ -52,7 +60,19 @@ typedef pthread_spinlock_t ptlock_t;
 #  define INIT_LOCK(lock)				pthread_spin_init((pthread_spinlock_t *) lock, PTHREAD_PROCESS_PRIVATE);
 #  define DESTROY_LOCK(lock)			        pthread_spin_destroy((pthread_spinlock_t *) lock)
 #  define LOCK(lock)					pthread_spin_lock((pthread_spinlock_t *) lock)
+#  define TRYLOCK(lock)					(pthread_spin_trylock((pthread_spinlock_t *) lock) == 0)
 #  define UNLOCK(lock)					pthread_spin_unlock((pthread_spinlock_t *) lock)
+#elif defined(FUTEX)		/* spin-then-park lock */
+
+#  include "futex_lock.h"
+
+typedef futex_lock_t ptlock_t;
+#  define LOCK_LOCAL_DATA                                
+#  define INIT_LOCK(lock)				futex_lock_init((futex_lock_t*) lock)
+#  define DESTROY_LOCK(lock)			
+#  define LOCK(lock)					futex_lock_lock((futex_lock_t*) lock)
+#  define TRYLOCK(lock)					futex_lock_trylock((futex_lock_t*) lock)
+#  define UNLOCK(lock)					futex_lock_unlock((futex_lock_t*) lock)
 #elif defined(TAS)			/* TAS */
 typedef volatile size_t ptlock_t;
 #  define LOCK_LOCAL_DATA                                
@@ -209,7 +229,7 @@ ticket_trylock(volatile ptlock_t* l)
     {
       COMPILER_NO_REORDER(uint64_t tc_old = tc;);
       tp->ticket++;
-      return CAS_U64((uint64_t*) l, tc_old, tc) == tc_old;
+      return __sync_val_compare_and_swap((uint64_t*) l, tc_old, tc) == tc_old;
     }
   else
     {
@@ -228,12 +248,38 @@ ticket_unlock(volatile ptlock_t* l)
 #  include "mcs.h"
 
 typedef mcs_lock_t ptlock_t;
-#define LOCK_LOCAL_DATA                                 __thread mcs_lock_local_t __mcs_local
+#define LOCK_LOCAL_DATA                                 __thread mcs_lock_local_t __mcs_local[MCS_LOCAL_NODES]
 
 #  define INIT_LOCK(lock)				mcs_lock_init((mcs_lock_t*) lock)
 #  define DESTROY_LOCK(lock)			        mcs_lock_destroy((mcs_lock_t*) lock)
 #  define LOCK(lock)					mcs_lock_lock((mcs_lock_t*) lock)
+#  define TRYLOCK(lock)					mcs_lock_trylock((mcs_lock_t*) lock)
 #  define UNLOCK(lock)					mcs_lock_unlock((mcs_lock_t*) lock)     
+#elif defined(CLH)		/* CLH lock */
+
+#  include "clh.h"
+
+typedef clh_lock_t ptlock_t;
+#define LOCK_LOCAL_DATA                                 __thread clh_qnode_t* __clh_free = NULL
+
+#  define INIT_LOCK(lock)				clh_lock_init((clh_lock_t*) lock)
+#  define DESTROY_LOCK(lock)			        clh_lock_destroy((clh_lock_t*) lock)
+#  define LOCK(lock)					clh_lock_lock((clh_lock_t*) lock)
+#  define TRYLOCK(lock)					clh_lock_trylock((clh_lock_t*) lock)
+#  define UNLOCK(lock)					clh_lock_unlock((clh_lock_t*) lock)
+#elif defined(COHORT)		/* C-TKT-MCS cohort lock */
+
+#  include "cohort.h"
+
+typedef cohort_lock_t ptlock_t;
+#define LOCK_LOCAL_DATA                                 __thread cohort_qnode_t* __cohort_free = NULL; \
+                                                        __thread int32_t __cohort_node = -1
+
+#  define INIT_LOCK(lock)				cohort_lock_init((cohort_lock_t*) lock)
+#  define DESTROY_LOCK(lock)			        cohort_lock_destroy((cohort_lock_t*) lock)
+#  define LOCK(lock)					cohort_lock_lock((cohort_lock_t*) lock)
+#  define TRYLOCK(lock)					cohort_lock_trylock((cohort_lock_t*) lock)
+#  define UNLOCK(lock)					cohort_lock_unlock((cohort_lock_t*) lock)
 #endif
 
 #endif	/* _LOCK_IF_H_ */
@@ -40,7 +40,7 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <linux/futex.h>
+#include "futex_lock.h"
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
@@ -72,7 +72,9 @@ swap_ptr(volatile void* ptr, void *x)
 }
 
 
-#define CACHE_LINE_SIZE 64
+#if !defined(CACHE_LINE_SIZE)
+#  define CACHE_LINE_SIZE 64
+#endif
 
 #if !defined(PAUSE_IN)
 #  define PAUSE_IN()			\
@@ -81,48 +83,71 @@ swap_ptr(volatile void* ptr, void *x)
 
 typedef struct mcs_lock 
 {
-  volatile uint64_t waiting;
+  volatile uint32_t waiting;	/* futex flag, see futex_lock.h */
   volatile struct mcs_lock* next;
 } mcs_lock_t;
 
+/* a thread can hold (or wait for) up to MCS_LOCAL_NODES MCS locks at
+   once: it has a queue node per lock, tagged with the lock */
+#define MCS_LOCAL_NODES 4
+
 typedef struct mcs_lock_local
 {
-  volatile uint64_t waiting;
+  volatile uint32_t waiting;
   volatile struct mcs_lock* next;
+  mcs_lock_t* lock;		/* the node is queued on (or holds) lock, or NULL */
 #if PADDING == 1
-  uint8_t padding[CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(struct mcs_lock*)];
+  uint8_t padding[CACHE_LINE_SIZE - sizeof(uint64_t) - 2 * sizeof(struct mcs_lock*)];
 #endif
 } mcs_lock_local_t;
 
-#define MCS_LOCK_INITIALIZER { .waiting = 0, .next = NULL, .local = { 0 } }
+#define MCS_LOCK_INITIALIZER { .waiting = 0, .next = NULL }
 
 
-extern __thread mcs_lock_local_t __mcs_local;
+extern __thread mcs_lock_local_t __mcs_local[MCS_LOCAL_NODES];
 
-static inline mcs_lock_t*
-mcs_get_local(lock)
+/* the calling thread's node for lock (with lock == NULL: a free node) */
+static inline mcs_lock_local_t*
+mcs_get_local(mcs_lock_t* lock)
 {
-  return (mcs_lock_t*) &__mcs_local;
+  int i;
+  for (i = 0; i < MCS_LOCAL_NODES; i++)
+    {
+      if (__mcs_local[i].lock == lock)
+	{
+	  return &__mcs_local[i];
+	}
+    }
+  fprintf(stderr, "mcs: more than %d MCS locks held at once\n", MCS_LOCAL_NODES);
+  abort();
 }
 
 
+/* returns 1 if the lock was free and is now held */
 static inline int
 mcs_lock_trylock(mcs_lock_t* lock) 
 {
   if (lock->next != NULL)
     {
-      return 1;
+      return 0;
     }
 
-  volatile mcs_lock_t* local = mcs_get_local();
+  mcs_lock_local_t* local = mcs_get_local(NULL);
   local->next = NULL;
-  return __sync_val_compare_and_swap(&lock->next, NULL, local) != NULL;
+  if (__sync_val_compare_and_swap(&lock->next, NULL, (mcs_lock_t*) local) != NULL)
+    {
+      return 0;
+    }
+  local->lock = lock;
+  return 1;
 }
 
 static inline int
 mcs_lock_lock(mcs_lock_t* lock) 
 {
-  volatile mcs_lock_t* local = mcs_get_local(lock);
+  mcs_lock_local_t* node = mcs_get_local(NULL);
+  node->lock = lock;
+  volatile mcs_lock_t* local = (mcs_lock_t*) node;
   local->next = NULL;
   
   mcs_lock_t* pred = swap_ptr((void*) &lock->next, (void*) local);
@@ -131,12 +156,9 @@ mcs_lock_lock(mcs_lock_t* lock)
     {
       return 0;
     }
-  local->waiting = 1; // word on which to spin
+  local->waiting = FUTEX_HELD; // word on which to spin
   pred->next = local; // make pred point to me
-  while (local->waiting != 0) 
-    {
-      PAUSE_IN();
-    }
+  futex_wait_zero(&local->waiting, FUTEX_SPIN_CYCLES); // spin, then park
   return 0;
 }
 
@@ -144,8 +166,10 @@ mcs_lock_lock(mcs_lock_t* lock)
 static inline int
 mcs_lock_unlock(mcs_lock_t* lock) 
 {
-  volatile mcs_lock_t* local = mcs_get_local();
+  mcs_lock_local_t* node = mcs_get_local(lock);
+  volatile mcs_lock_t* local = (mcs_lock_t*) node;
   volatile mcs_lock_t* succ;
+  node->lock = NULL;
 
   if (!(succ = local->next)) /* I seem to have no succ. */
     { 
@@ -161,7 +185,7 @@ mcs_lock_unlock(mcs_lock_t* lock)
 	} 
       while (!succ); // wait for successor
     }
-  succ->waiting = 0;
+  futex_clear(&succ->waiting);
   return 0;
 }
 
@@ -8,6 +8,11 @@
 #include <stdarg.h>
 
 #include "sstm_alloc.h"
+#include "sstm_orec.h"
+#include "sstm_log.h"
+#include "sstm_algo.h"
+#include "sstm_stats.h"
+#include "sstm_numa.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -15,19 +20,109 @@ extern "C" {
 
 #define DEBUG 0
 
-#define TTAS
+  /* the lock family of the global lock (see lock_if.h): FUTEX (spins,
+     then parks), unless the build selects another one (make LOCK=TTAS) */
+#if !defined(MUTEX) && !defined(SPIN) && !defined(TAS) && !defined(TTAS) && !defined(TICKET) \
+  && !defined(MCS) && !defined(CLH) && !defined(COHORT) && !defined(FUTEX)
+#  define FUTEX
+#endif
 #include "lock_if.h"
+#include "futex_lock.h"
+
+#if !defined(CACHE_LINE_SIZE)
+#  define CACHE_LINE_SIZE 64
+#endif
+
+#if !defined(PAUSE)
+#  define PAUSE() asm volatile ("pause")
+#endif
+
+  /* what a TX_START() site is known to do; sites that never store
+     run in read-only mode (no read-set logging, no commit-time work) */
+#define SSTM_SITE_UNKNOWN       0 /* update mode until the first commit */
+#define SSTM_SITE_RO            1 /* has only committed without stores */
+#define SSTM_SITE_RW            2 /* has stored (sticky) */
+
+  /* a TX that aborted SSTM_SERIAL_AFTER times in a row retries in
+     serial (irrevocable) mode: it holds the global lock and runs alone
+     once the optimistic TXs in flight have drained (0: never) */
+#define SSTM_SERIAL_AFTER_DEFAULT 100
+#define SSTM_SERIAL_AFTER_ENV     "SSTM_SERIAL_AFTER"
+
+  /* TXs waiting for a serial TX, the serial TX waiting for the TXs in
+     flight, and contention-manager waits spin for SSTM_PARK_AFTER
+     cycles, then sleep in the kernel (futex) until woken (0: always
+     spin). Timed waits sleep at most SSTM_PARK_SLICE_US at once */
+#define SSTM_PARK_AFTER_DEFAULT FUTEX_SPIN_CYCLES
+#define SSTM_PARK_AFTER_ENV     "SSTM_PARK_AFTER"
+#define SSTM_PARK_SLICE_US      50
+
+  /* a TX_START() inside a TX is flattened into it by default; with
+     closed nesting, conflicts roll back (and retry) only the innermost
+     nested TX, up to SSTM_NEST_RETRIES times before its parent is
+     rolled back too. Levels beyond SSTM_NEST_MAX are flattened */
+#define SSTM_NESTING_ENV        "SSTM_NESTING"
+#define SSTM_NEST_MAX           8
+#define SSTM_NEST_RETRIES       8
+
+#define SSTM_MAX_THREADS        1024
+
+#define SSTM_RANGE_BUF_WORDS    64 /* bounce buffer of TX_LOAD_RANGE() to misaligned memory */
 
   /* **************************************************************************************************** */
   /* structures */
   /* **************************************************************************************************** */
 
+  /* a closed nested TX: where to retry it from, and the log positions
+     to roll back to (see sstm_nest.c) */
+  typedef struct sstm_nest_level
+  {
+    sigjmp_buf env;
+    size_t depth;		/* sstm_meta.nesting inside this TX */
+    size_t retries;
+    sstm_log_pos_t read_set;
+    sstm_log_pos_t write_set;
+    sstm_log_pos_t undo_log;
+    sstm_log_pos_t nest_log;
+    sstm_log_pos_t allocs;
+    sstm_log_pos_t frees;
+  } sstm_nest_level_t;
+
   typedef struct sstm_metadata
   {
     sigjmp_buf env;		/* Environment for setjmp/longjmp */
     size_t id;
+    int numa_node;		/* the thread is pinned to this node, or -1 */
+    sstm_algo_id_t algo_id;	/* loads/stores dispatch: the global one, or GL in serial mode */
     size_t n_commits;
     size_t n_aborts;
+    size_t start_ts;		/* snapshot of the global clock at TX start */
+    uint8_t ro;			/* current attempt runs in read-only mode */
+    uint8_t ro_disable;		/* retry in update mode (set by the algorithm) */
+    uint8_t wrote;		/* current attempt stored */
+    sstm_site_t* site;		/* the TX_START() site */
+    sstm_site_stats_t* site_stats_cur; /* this thread's counters for site */
+    sstm_site_stats_t* site_stats; /* indexed by site id */
+    size_t site_stats_size;
+    size_t n_retries;		/* aborts of the current TX so far */
+    int abort_value;		/* argument of the last TX_ABORT() */
+    sstm_stats_t stats;		/* see sstm_stats.h */
+    uint64_t tx_begin;		/* getticks() at the first attempt of the TX */
+    sstm_latency_t latency;
+    uint8_t serial_next;	/* retry in serial mode */
+    uint8_t irrevocable;	/* current attempt runs in serial mode */
+    size_t cm_karma;		/* contention manager state (see sstm_cm.h) */
+    volatile uintptr_t* cm_enemy; /* last orec found locked by another TX */
+    uintptr_t cm_enemy_orec;	/* and its value then */
+    unsigned long cm_seeds[3];
+    sstm_read_set_t read_set;
+    sstm_write_set_t write_set;
+    sstm_undo_log_t undo_log;	/* for write-through algorithms */
+    size_t nesting;		/* TX_START()s not committed yet */
+    size_t nest_n;		/* closed nested TXs in nest[] */
+    sstm_nest_level_t nest[SSTM_NEST_MAX];
+    sstm_undo_log_t nest_log;	/* old values of write-set entries
+				   overwritten by closed nested TXs */
   } sstm_metadata_t;
 
   typedef struct sstm_metadata_global
@@ -35,11 +130,40 @@ extern "C" {
     ptlock_t glock;
     size_t n_commits;
     size_t n_aborts;
-  } sstm_metadata_global_t;
-
+    size_t n_threads;		/* used to hand out thread ids */
+    sstm_algo_id_t algo_id;	/* algorithm selected at sstm_start() */
+    const sstm_algo_t* algo;
+    int clock_id;		/* sstm_clock_id_t, see sstm_clock.h */
+    size_t clock_base;		/* TSC at sstm_start(), for the tsc clock */
+    const struct sstm_cm* cm;	/* contention manager, see sstm_cm.h */
+    int cm_id;			/* sstm_cm_id_t */
+    const struct sstm_validate* validate; /* read-set validation kernels, see sstm_validate.h */
+    int validate_id;		/* sstm_validate_id_t */
+    int nesting_closed;		/* closed (or flat) nesting */
+    sstm_orec_table_t orecs;	/* versioned lock table */
+    size_t serial_after;	/* aborts before switching to serial mode (0: never) */
+    int serial_membarrier;	/* membarrier() fences TX starts for the serial TX */
+    uint64_t park_after;	/* cycles of spinning before a wait parks (0: never) */
+    volatile uint32_t serial __attribute__ ((aligned(CACHE_LINE_SIZE))); /* a serial TX holds glock (futex flag) */
+    volatile size_t epoch __attribute__ ((aligned(CACHE_LINE_SIZE))); /* reclamation epoch (>= 1), see sstm_alloc.c */
+    volatile size_t clock __attribute__ ((aligned(CACHE_LINE_SIZE))); /* global version clock */
+    volatile size_t seqlock __attribute__ ((aligned(CACHE_LINE_SIZE))); /* NORec sequence lock (odd: locked) */
+  } __attribute__ ((aligned(CACHE_LINE_SIZE))) sstm_metadata_global_t;
+
+
+  /* per-thread slot: 0 while the thread runs no optimistic TX, otherwise
+     the reclamation epoch it announced at TX start (the serial TX waits
+     for the slots to be 0, reclamation for them to reach the epoch) */
+  typedef struct sstm_thread_slot
+  {
+    volatile size_t active;
+    volatile size_t snapshot;	/* 1 + start time of the running read-only TX (mvcc), or 0 */
+    uint8_t padding[CACHE_LINE_SIZE - 2 * sizeof(size_t)];
+  } sstm_thread_slot_t;
 
 extern __thread sstm_metadata_t sstm_meta;
 extern sstm_metadata_global_t sstm_meta_global;
+extern sstm_thread_slot_t sstm_thread_slots[SSTM_MAX_THREADS];
 
 
   /* **************************************************************************************************** */
@@ -66,25 +190,68 @@ extern sstm_metadata_global_t sstm_meta_global;
   /* TM macros */
   /* **************************************************************************************************** */
 
-#define TX_START()					\
-  { PRINTD("|| Starting new tx\n");			\
-    short int reason;					\
-    if ((reason = sigsetjmp(sstm_meta.env, 0)) != 0)	\
-      {							\
-	UNLOCK(&sstm_meta_global.glock);		\
-	sstm_tx_cleanup();				\
-	PRINTD("|| restarting due to %d\n", reason);	\
-      }							\
-    LOCK(&sstm_meta_global.glock);			\
+#define TX_START()				\
+  TX_START_SITE(SSTM_SITE_UNKNOWN, NULL)
+
+  /* hint that the TX does not write; if it does, it is
+     transparently restarted in update mode */
+#define TX_START_RO()				\
+  TX_START_SITE(SSTM_SITE_RO, NULL)
+
+  /* name the site in the profile (SSTM_PROFILE) instead of file:line only */
+#define TX_START_LABEL(label)			\
+  TX_START_SITE(SSTM_SITE_UNKNOWN, label)
+
+#define TX_START_RO_LABEL(label)		\
+  TX_START_SITE(SSTM_SITE_RO, label)
+
+  /* inside a TX, starts a nested TX: flattened, or closed with its own
+     restart point */
+#define TX_START_SITE(init, lbl)				\
+  { PRINTD("|| Starting new tx\n");				\
+    static sstm_site_t __sstm_site =				\
+      { .state = init, .file = __FILE__, .line = __LINE__,	\
+	.func = __func__, .label = lbl };			\
+    short int reason;						\
+    if (__builtin_expect(sstm_meta.nesting == 0, 1))		\
+      {								\
+	if ((reason = sigsetjmp(sstm_meta.env, 0)) != 0)	\
+	  {							\
+	    sstm_tx_cleanup(reason);				\
+	    PRINTD("|| restarting due to %d\n", reason);	\
+	  }							\
+	sstm_tx_start(&__sstm_site);				\
+      }								\
+    else							\
+      {								\
+	sstm_nest_level_t* __sstm_level = sstm_nest_push();	\
+	if (__sstm_level != NULL)				\
+	  {							\
+	    if ((reason = sigsetjmp(__sstm_level->env, 0)) != 0) \
+	      {							\
+		sstm_nest_rollback(__sstm_level, reason);	\
+		PRINTD("|| restarting nested tx due to %d\n", reason); \
+	      }							\
+	  }							\
+      }								\
   }
 
 #define TX_COMMIT()				\
   sstm_tx_commit();				\
   PRINTD("|| commited tx (%zu)\n", sstm_meta.n_commits);     
 
-#define TX_ABORT(reason)			\
-  PRINTD("|| aborting tx (%d)\n", reason);	\
-  siglongjmp(sstm_meta.env, reason);
+  /* the transaction aborts as SSTM_ABORT_EXPLICIT, whatever reason is:
+     reason is kept in sstm_meta.abort_value */
+#define TX_ABORT(reason)				\
+  do {							\
+    PRINTD("|| aborting tx (%d)\n", reason);		\
+    sstm_tx_abort_explicit(reason);			\
+  } while (0)
+
+  /* from here on, the TX cannot abort (e.g., before an operation that
+     cannot be rolled back); it is restarted in serial mode if needed */
+#define TX_IRREVOCABLE()			\
+  sstm_tx_irrevocable()
 
 #define TX_LOAD(addr)				\
   sstm_tx_load((volatile uintptr_t*) addr)
@@ -92,6 +259,36 @@ extern sstm_metadata_global_t sstm_meta_global;
 #define TX_STORE(addr, val)			\
   sstm_tx_store((volatile uintptr_t*) addr, (uintptr_t) val)
 
+  /* naturally aligned 1-, 2- and 4-byte fields: the word holding the
+     field is accessed (and, for stores, written back with the other
+     bytes unchanged) */
+#define TX_LOAD8(addr)				\
+  ((uint8_t) sstm_tx_load_bytes((volatile void*) addr, 1))
+
+#define TX_LOAD16(addr)				\
+  ((uint16_t) sstm_tx_load_bytes((volatile void*) addr, 2))
+
+#define TX_LOAD32(addr)				\
+  ((uint32_t) sstm_tx_load_bytes((volatile void*) addr, 4))
+
+#define TX_STORE8(addr, val)			\
+  sstm_tx_store_bytes((volatile void*) addr, (uintptr_t) val, 1)
+
+#define TX_STORE16(addr, val)			\
+  sstm_tx_store_bytes((volatile void*) addr, (uintptr_t) val, 2)
+
+#define TX_STORE32(addr, val)			\
+  sstm_tx_store_bytes((volatile void*) addr, (uintptr_t) val, 4)
+
+  /* copies size bytes from shared memory at src to private memory at
+     dst, checking the metadata of every stripe once */
+#define TX_LOAD_RANGE(dst, src, size)		\
+  sstm_tx_load_range((void*) dst, (volatile void*) src, size)
+
+  /* copies size bytes from private memory at src to shared memory at dst */
+#define TX_STORE_RANGE(dst, src, size)		\
+  sstm_tx_store_range((volatile void*) dst, (const void*) src, size)
+
 #define TX_MALLOC(size)				\
   sstm_tx_alloc(size)
 
@@ -103,6 +300,9 @@ extern sstm_metadata_global_t sstm_meta_global;
   /* externs */
   /* **************************************************************************************************** */
 
+  /* initializes the TM runtime with the algorithm selected with
+     sstm_set_algo() or the SSTM_ALGO environment variable
+  */
   extern void sstm_start();
   /* terminates the TM runtime
      (e.g., deallocates the locks that the system uses ) 
@@ -121,23 +321,239 @@ extern sstm_metadata_global_t sstm_meta_global;
      ****** DO NOT CHANGE THE EXISTING CODE*********   
      */
   extern void sstm_thread_stop();
-  /* transactionally reads the value of addr
-   */
-  extern inline uintptr_t sstm_tx_load(volatile uintptr_t* addr);
-  /* transactionally writes val in addr
-   */
-  extern inline void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val);
+  /* starts (or restarts) a transaction from the given TX_START() site
+     (e.g., takes a snapshot of the global clock)
+  */
+  extern void sstm_tx_start(sstm_site_t* site);
+  /* a read-only TX tried to store: marks its site as updating and
+     restarts the TX in update mode
+  */
+  extern void sstm_tx_upgrade() __attribute__ ((noreturn));
+  /* makes the TX irrevocable: restarts it in serial mode, unless it
+     already runs alone
+  */
+  extern void sstm_tx_irrevocable();
   /* cleaning up in case of an abort 
      (e.g., flush the read or write logs)
   */
-  extern void sstm_tx_cleanup();
+  extern void sstm_tx_cleanup(int reason);
   /* tries to commit a transaction
      (e.g., validates some version number, and/or
      acquires a couple of locks)
   */
   extern void sstm_tx_commit();
+  /* TX_START() inside a TX: returns the closed nested TX to restart
+     from on a conflict, or NULL if it is flattened into its parent
+  */
+  extern sstm_nest_level_t* sstm_nest_push();
+  /* TX_COMMIT() of a nested TX: its reads and writes become its parent's
+  */
+  extern void sstm_nest_commit();
+  /* a conflict in the closed nested TX l: rolls it back, so that it can
+     be retried, or rolls back its parent if the parent's reads are not
+     valid anymore
+  */
+  extern void sstm_nest_rollback(sstm_nest_level_t* l, int reason);
+  /* rolls the write set back to the start of the nested TX l (for the
+     tx_rollback of write-back algorithms)
+  */
+  extern void sstm_nest_write_set_rewind(const sstm_nest_level_t* l);
+  /* makes the slot updates of TX starts in flight visible to the caller
+     (membarrier(), or a full fence if TX starts have one)
+  */
+  extern void sstm_slots_fence();
 
+  /* selects the algorithm (by name, e.g., "tl2") to be used by the next
+     sstm_start(); the SSTM_ALGO environment variable takes precedence.
+     returns 0 on success, -1 if the name is unknown
+  */
+  extern int sstm_set_algo(const char* name);
+  /* name of the algorithm in use
+  */
+  extern const char* sstm_algo_name();
+  /* selects the global clock scheme of orec-based algorithms (by name,
+     e.g., "gv4") for the next sstm_start(); the SSTM_CLOCK environment
+     variable takes precedence. returns 0 on success, -1 if unknown or
+     unsupported (tsc without an invariant TSC)
+  */
+  extern int sstm_set_clock(const char* name);
+  extern const char* sstm_clock_name();
+  /* selects the contention manager (by name, e.g., "greedy") for the
+     next sstm_start(); the SSTM_CM environment variable takes precedence.
+     returns 0 on success, -1 if unknown
+  */
+  extern int sstm_set_cm(const char* name);
+  extern const char* sstm_cm_name();
+  /* selects the read-set validation kernels (by name, e.g., "scalar")
+     for the next sstm_start(); the SSTM_VALIDATE environment variable
+     takes precedence. By default, the best the CPU supports. returns 0
+     on success, -1 if unknown or not supported by the CPU
+  */
+  extern int sstm_set_validate(const char* name);
+  extern const char* sstm_validate_name();
+  /* selects "flat" or "closed" nesting for the next sstm_start(); the
+     SSTM_NESTING environment variable takes precedence. returns 0 on
+     success, -1 if unknown
+  */
+  extern int sstm_set_nesting(const char* name);
+  extern const char* sstm_nesting_name();
+  /* TX_LOAD_RANGE() and TX_STORE_RANGE(): any size and alignment */
+  extern void sstm_tx_load_range(void* dst, volatile void* src, size_t size);
+  extern void sstm_tx_store_range(volatile void* dst, const void* src, size_t size);
+
+  /* the conflicts that a closed nested TX can retry on its own */
+  static inline int
+  sstm_nest_partial(int reason)
+  {
+    return reason == SSTM_ABORT_RW_CONFLICT || reason == SSTM_ABORT_WW_CONFLICT
+      || reason == SSTM_ABORT_VALIDATION || reason == SSTM_ABORT_LOCK_TIMEOUT;
+  }
 
+  /* aborts for reason (SSTM_ABORT_*, see sstm_stats.h): restarts the
+     innermost closed nested TX on a conflict, the whole TX otherwise
+  */
+  static inline void __attribute__ ((noreturn))
+  sstm_tx_abort(int reason)
+  {
+    if (__builtin_expect(sstm_meta.nest_n > 0, 0) && sstm_nest_partial(reason))
+      {
+	siglongjmp(sstm_meta.nest[sstm_meta.nest_n - 1].env, reason);
+      }
+    siglongjmp(sstm_meta.env, reason);
+  }
+
+  /* TX_ABORT(value): the user's value never reaches the abort reasons */
+  static inline void __attribute__ ((noreturn))
+  sstm_tx_abort_explicit(int value)
+  {
+    sstm_meta.abort_value = value;
+    sstm_tx_abort(SSTM_ABORT_EXPLICIT);
+  }
+
+  /* a write-back store overwrites the entry w of the write set: a closed
+     nested TX keeps the old value, for its rollback
+  */
+  static inline void
+  sstm_nest_save(const sstm_write_entry_t* w)
+  {
+    if (__builtin_expect(sstm_meta.nest_n > 0, 0))
+      {
+	sstm_write_entry_t* u = sstm_undo_log_add(&sstm_meta.nest_log);
+	u->addr = w->addr;
+	u->val = w->val;
+      }
+  }
+
+  /* transactionally reads the value of addr
+     (a direct call to the selected algorithm, or a plain load in serial mode)
+  */
+  static inline uintptr_t
+  sstm_tx_load(volatile uintptr_t* addr)
+  {
+    switch (sstm_meta.algo_id)
+      {
+      case SSTM_ALGO_TL2:
+	return sstm_tl2_tx_load(addr);
+      case SSTM_ALGO_NOREC:
+	return sstm_norec_tx_load(addr);
+      case SSTM_ALGO_TINY:
+	return sstm_tiny_tx_load(addr);
+      case SSTM_ALGO_MVCC:
+	return sstm_mvcc_tx_load(addr);
+      default:
+	return *addr;
+      }
+  }
+
+  /* transactionally writes val in addr
+     (a direct call to the selected algorithm)
+  */
+  static inline void
+  sstm_tx_store(volatile uintptr_t* addr, uintptr_t val)
+  {
+    if (__builtin_expect(sstm_meta.ro, 0))
+      {
+	sstm_tx_upgrade();
+      }
+    sstm_meta.wrote = 1;
+
+    switch (sstm_meta.algo_id)
+      {
+      case SSTM_ALGO_TL2:
+	sstm_tl2_tx_store(addr, val);
+	break;
+      case SSTM_ALGO_NOREC:
+	sstm_norec_tx_store(addr, val);
+	break;
+      case SSTM_ALGO_TINY:
+	sstm_tiny_tx_store(addr, val);
+	break;
+      case SSTM_ALGO_MVCC:	/* buffered as in TL2 */
+	sstm_tl2_tx_store(addr, val);
+	break;
+      default:
+	*addr = val;
+      }
+  }
+
+
+  /* transactionally reads n (aligned) words from src into dst
+     (the stripes of the range are checked once each)
+  */
+  static inline void
+  sstm_tx_load_words(uintptr_t* dst, volatile uintptr_t* src, size_t n)
+  {
+    size_t i;
+    switch (sstm_meta.algo_id)
+      {
+      case SSTM_ALGO_TL2:
+	sstm_tl2_tx_load_range(dst, src, n);
+	break;
+      case SSTM_ALGO_NOREC:
+	sstm_norec_tx_load_range(dst, src, n);
+	break;
+      case SSTM_ALGO_TINY:
+	sstm_tiny_tx_load_range(dst, src, n);
+	break;
+      case SSTM_ALGO_MVCC:
+	sstm_mvcc_tx_load_range(dst, src, n);
+	break;
+      default:
+	for (i = 0; i < n; i++)
+	  {
+	    dst[i] = src[i];
+	  }
+      }
+  }
+
+  static inline uintptr_t
+  sstm_bytes_mask(size_t size)
+  {
+    return size < sizeof(uintptr_t) ? (1UL << (8 * size)) - 1 : ~0UL;
+  }
+
+  /* transactionally reads size bytes at addr, which must not cross a
+     word boundary (little endian)
+  */
+  static inline uintptr_t
+  sstm_tx_load_bytes(volatile void* addr, size_t size)
+  {
+    size_t off = (uintptr_t) addr & (sizeof(uintptr_t) - 1);
+    assert(off + size <= sizeof(uintptr_t));
+    uintptr_t w = sstm_tx_load((volatile uintptr_t*) ((uintptr_t) addr - off));
+    return (w >> (8 * off)) & sstm_bytes_mask(size);
+  }
+
+  static inline void
+  sstm_tx_store_bytes(volatile void* addr, uintptr_t val, size_t size)
+  {
+    size_t off = (uintptr_t) addr & (sizeof(uintptr_t) - 1);
+    assert(off + size <= sizeof(uintptr_t));
+    volatile uintptr_t* waddr = (volatile uintptr_t*) ((uintptr_t) addr - off);
+    uintptr_t mask = sstm_bytes_mask(size) << (8 * off);
+    uintptr_t w = (size == sizeof(uintptr_t)) ? 0 : sstm_tx_load(waddr);
+    sstm_tx_store(waddr, (w & ~mask) | ((val << (8 * off)) & mask));
+  }
 
 
   /* **************************************************************************************************** */
@@ -0,0 +1,90 @@
+#ifndef _SSTM_ALGO_H_
+#define	_SSTM_ALGO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* STM algorithms linked in libsstm.a */
+  /* **************************************************************************************************** */
+
+  typedef enum sstm_algo_id
+    {
+      SSTM_ALGO_GL,		/* global lock */
+      SSTM_ALGO_TL2,		/* TL2 (default) */
+      SSTM_ALGO_NOREC,		/* NORec */
+      SSTM_ALGO_TINY,		/* TinySTM/LSA, write-through */
+      SSTM_ALGO_MVCC,		/* TL2 with multi-version read-only TXs */
+      SSTM_ALGO_NUM
+    } sstm_algo_id_t;
+
+#define SSTM_ALGO_DEFAULT SSTM_ALGO_TL2
+#define SSTM_ALGO_ENV     "SSTM_ALGO"
+
+  struct sstm_nest_level;
+
+  /* dispatch table of an algorithm: everything but loads and stores,
+     which sstm_tx_load()/sstm_tx_store() call directly */
+  typedef struct sstm_algo
+  {
+    const char* name;
+    int read_only;		/* supports the read-only mode */
+    int serial;			/* supports the serial-mode fallback */
+    void (*start)();
+    void (*stop)();
+    void (*thread_start)();
+    void (*thread_stop)();
+    void (*tx_start)();
+    void (*tx_cleanup)();
+    void (*tx_commit)();
+    /* closed nesting (NULL: nested TXs are flattened): forgets the
+       accesses of the nested TX after an abort for reason, then
+       returns 1 if it can be retried (e.g., the snapshot could be
+       extended to the current time), 0 if its parent must be rolled
+       back too (e.g., a read of the parent is not valid anymore) */
+    int (*tx_rollback)(const struct sstm_nest_level* l, int reason);
+  } sstm_algo_t;
+
+  extern const sstm_algo_t sstm_algo_gl;
+  extern const sstm_algo_t sstm_algo_tl2;
+  extern const sstm_algo_t sstm_algo_norec;
+  extern const sstm_algo_t sstm_algo_tiny;
+  extern const sstm_algo_t sstm_algo_mvcc;
+
+  extern uintptr_t sstm_tl2_tx_load(volatile uintptr_t* addr);
+  extern void sstm_tl2_tx_store(volatile uintptr_t* addr, uintptr_t val);
+  extern void sstm_tl2_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n);
+  extern uintptr_t sstm_norec_tx_load(volatile uintptr_t* addr);
+  extern void sstm_norec_tx_store(volatile uintptr_t* addr, uintptr_t val);
+  extern void sstm_norec_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n);
+  extern uintptr_t sstm_tiny_tx_load(volatile uintptr_t* addr);
+  extern void sstm_tiny_tx_store(volatile uintptr_t* addr, uintptr_t val);
+  extern void sstm_tiny_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n);
+  extern int sstm_tl2_tx_rollback(const struct sstm_nest_level* l, int reason);
+  extern uintptr_t sstm_mvcc_tx_load(volatile uintptr_t* addr);
+  extern void sstm_mvcc_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n);
+
+  /* MVCC: past versions kept per stripe (beyond, read-only TXs that
+     need older ones abort), and the period of the collector thread
+     that trims them. The collector locks orecs as owner SSTM_MVCC_OWNER */
+#define SSTM_MVCC_VERSIONS      16
+#define SSTM_MVCC_GC_PERIOD     1000 /* us */
+#define SSTM_MVCC_GROUP_SHIFT   9    /* chains per dirty flag: 512 */
+#define SSTM_MVCC_BATCH         256  /* versions per slab, and per free list */
+#define SSTM_MVCC_SPIN          1024 /* spins on a locked orec before yielding */
+#define SSTM_MVCC_OWNER         0xFFFF
+
+  /* helpers shared by the orec-based algorithms */
+  extern void sstm_orecs_create();
+  extern void sstm_orecs_destroy();
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_ALGO_H_ */
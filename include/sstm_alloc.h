@@ -9,22 +9,40 @@
 extern "C" {
 #endif
 
-#define SSTM_ALLOC_MAX_ALLOCS 16
-
-  typedef struct sstm_alloc
-  {
-    union
-    {
-      size_t n_allocs;
-      size_t n_frees;
-    };
-    void* mem[SSTM_ALLOC_MAX_ALLOCS];
-  } sstm_alloc_t;
+  /* TX_MALLOC() objects come from per-thread pools of cache-line
+     aligned size classes up to SSTM_POOL_MAX_SIZE bytes. TX_FREE()
+     only accepts memory from TX_MALLOC() */
+#define SSTM_POOL_GRAIN         64 /* a cache line */
+#define SSTM_POOL_CLASSES       32
+#define SSTM_POOL_MAX_SIZE      (SSTM_POOL_CLASSES * SSTM_POOL_GRAIN)
+#define SSTM_POOL_SLAB_SIZE     (64 * 1024UL)
+#define SSTM_POOL_REGION_SIZE   (16 * SSTM_POOL_SLAB_SIZE)
+
+  /* TX_FREE()d objects wait in per-thread limbo lists until every TX
+     that may still read them has finished (see sstm_alloc.c) */
+#define SSTM_EPOCH_LIMBOS       3 /* objects retired in the last 3 epochs */
+#define SSTM_EPOCH_BATCH        128 /* retired objects between reclamations */
 
   void*  sstm_tx_alloc(size_t size);
   void sstm_tx_free(void* mem);
   void sstm_alloc_on_abort();
   void sstm_alloc_on_commit();
+  /* closed nesting: the positions in the TX_MALLOC() and TX_FREE() logs,
+     and the rollback to them (which frees the memory allocated since) */
+  struct sstm_log_pos;
+  void sstm_alloc_mark(struct sstm_log_pos* allocs, struct sstm_log_pos* frees);
+  void sstm_alloc_rewind(const struct sstm_log_pos* allocs, const struct sstm_log_pos* frees);
+  size_t sstm_tx_alloc_size(void* mem);
+  /* the logs of the TX_MALLOC()s and TX_FREE()s of the current TX */
+  void sstm_alloc_thread_start();
+  void sstm_alloc_thread_stop();
+  /* the calling thread stops: hands its pool over to the next thread */
+  void sstm_pool_release();
+  /* the calling thread stops: waits until its limbo lists can be reclaimed */
+  void sstm_epoch_thread_stop();
+  /* tries to advance the epoch, and returns it: memory unlinked (and
+     fenced) in epoch e can be reused once the epoch is e + 2 */
+  size_t sstm_epoch_advance();
 
 
 #ifdef	__cplusplus
@@ -0,0 +1,132 @@
+#ifndef _SSTM_CLOCK_H_
+#define	_SSTM_CLOCK_H_
+
+#include "sstm.h"
+#include "random.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* global version clock schemes of the orec-based algorithms (selected with SSTM_CLOCK) */
+  /* **************************************************************************************************** */
+
+  /*
+     gv1 : fetch-and-increment on every update commit (default)
+     gv4 : pass on failure: a single CAS attempt; on failure, adopt the
+           value written by the winner (committers may share a timestamp)
+     gv5 : deferred increment: commits use clock + 1 without writing the
+           clock; readers that see a newer version advance the clock
+     gv6 : gv5, but one commit out of SSTM_CLOCK_GV6_PERIOD (per thread)
+           increments the clock as gv1 does
+     tsc : the invariant TSC (getticks()), relative to sstm_start(), in
+           units of 2^SSTM_CLOCK_TSC_SHIFT cycles; no shared writes at all
+  */
+
+  typedef enum sstm_clock_id
+    {
+      SSTM_CLOCK_GV1,
+      SSTM_CLOCK_GV4,
+      SSTM_CLOCK_GV5,
+      SSTM_CLOCK_GV6,
+      SSTM_CLOCK_TSC,
+      SSTM_CLOCK_NUM
+    } sstm_clock_id_t;
+
+#define SSTM_CLOCK_DEFAULT     SSTM_CLOCK_GV1
+#define SSTM_CLOCK_ENV         "SSTM_CLOCK"
+#define SSTM_CLOCK_GV6_PERIOD  32
+#define SSTM_CLOCK_TSC_SHIFT   6 /* 2^47 versions last ~35 days at 4GHz */
+
+  extern const char* sstm_clock_names[SSTM_CLOCK_NUM];
+
+  static inline size_t
+  sstm_clock_tsc()
+  {
+    asm volatile ("lfence" ::: "memory");
+    size_t t = (getticks() - sstm_meta_global.clock_base) >> SSTM_CLOCK_TSC_SHIFT;
+    asm volatile ("lfence" ::: "memory");
+    return t;
+  }
+
+  /* the snapshot timestamp for a starting (or extending) transaction */
+  static inline size_t
+  sstm_clock_read()
+  {
+    if (sstm_meta_global.clock_id == SSTM_CLOCK_TSC)
+      {
+	return sstm_clock_tsc();
+      }
+    return sstm_meta_global.clock;
+  }
+
+  /* a reader saw an orec version newer than its snapshot: with deferred
+     increments, the clock must be advanced up to that version */
+  static inline void
+  sstm_clock_observe(size_t version)
+  {
+    if (sstm_meta_global.clock_id == SSTM_CLOCK_GV5 || sstm_meta_global.clock_id == SSTM_CLOCK_GV6)
+      {
+	size_t c;
+	while ((c = sstm_meta_global.clock) < version)
+	  {
+	    if (__sync_bool_compare_and_swap(&sstm_meta_global.clock, c, version))
+	      {
+		break;
+	      }
+	  }
+      }
+  }
+
+  /* the commit timestamp of an update transaction that holds its locks:
+     greater than the snapshot of every transaction that might have read
+     the old values. *validate is cleared when no other transaction can
+     have committed since start_ts, so that read-set validation can be
+     skipped */
+  static inline size_t
+  sstm_clock_commit(size_t start_ts, int* validate)
+  {
+    size_t c, ts;
+    *validate = 1;
+
+    switch (sstm_meta_global.clock_id)
+      {
+      case SSTM_CLOCK_GV4:
+	c = sstm_meta_global.clock;
+	ts = __sync_val_compare_and_swap(&sstm_meta_global.clock, c, c + 1);
+	if (ts == c)
+	  {
+	    *validate = (c != start_ts);
+	    return c + 1;
+	  }
+	return ts;		/* the winner's timestamp */
+      case SSTM_CLOCK_GV6:
+	if (sstm_meta.n_commits % SSTM_CLOCK_GV6_PERIOD == 0)
+	  {
+	    return __sync_add_and_fetch(&sstm_meta_global.clock, 1);
+	  }
+	return sstm_meta_global.clock + 1;
+      case SSTM_CLOCK_GV5:
+	return sstm_meta_global.clock + 1;
+      case SSTM_CLOCK_TSC:
+	asm volatile ("mfence" ::: "memory");
+	ts = sstm_clock_tsc() + 1;
+	while (sstm_clock_tsc() < ts)
+	  {
+	    PAUSE();
+	  }
+	return ts;
+      default:
+	ts = __sync_add_and_fetch(&sstm_meta_global.clock, 1);
+	*validate = (ts != start_ts + 1);
+	return ts;
+      }
+  }
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_CLOCK_H_ */
@@ -0,0 +1,160 @@
+#ifndef _SSTM_CM_H_
+#define	_SSTM_CM_H_
+
+#include "sstm.h"
+#include "random.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* contention managers (selected with SSTM_CM) */
+  /* **************************************************************************************************** */
+
+  /*
+     none      : retry immediately
+     backoff   : randomized exponential backoff after every conflict abort (default)
+     karma     : priority is the work (accesses) done by the aborted attempts
+                 of the TX; the higher priority waits for the lock to be
+                 released, the lower one waits briefly, then aborts
+     greedy    : priority is the time of the first attempt; the older TX
+                 waits for the lock, the younger aborts and waits for the
+                 older one to release it before retrying
+     timestamp : oldest wins; the older TX waits (for a shorter time than
+                 greedy), the younger aborts and retries immediately
+
+     Locks can only be released by their owner, so "winning" a conflict
+     means waiting for the owner instead of aborting. All waits are
+     bounded, so two transactions can never wait for each other forever.
+     Waits longer than SSTM_PARK_AFTER cycles sleep on the owner's slot,
+     which the owner bumps (and wakes) once it has released its locks.
+  */
+
+  typedef enum sstm_cm_id
+    {
+      SSTM_CM_NONE,
+      SSTM_CM_BACKOFF,
+      SSTM_CM_KARMA,
+      SSTM_CM_GREEDY,
+      SSTM_CM_TIMESTAMP,
+      SSTM_CM_NUM
+    } sstm_cm_id_t;
+
+#define SSTM_CM_DEFAULT         SSTM_CM_BACKOFF
+#define SSTM_CM_ENV             "SSTM_CM"
+
+#define SSTM_CM_MAX_THREADS     1024	  /* priority slots, indexed by thread id */
+#define SSTM_CM_WAIT_MAX        (1UL << 16) /* cycles a winner waits for a lock */
+#define SSTM_CM_TIMESTAMP_WAIT  (1UL << 12)
+#define SSTM_CM_KARMA_WAIT      (1UL << 10) /* cycles a karma loser waits */
+#define SSTM_CM_BACKOFF_UNIT    128	  /* cycles */
+#define SSTM_CM_BACKOFF_MAX_EXP 10
+
+  typedef struct sstm_cm
+  {
+    const char* name;
+    void (*tx_start)();		/* first attempt of a TX */
+    void (*tx_abort)(size_t work); /* after a conflict abort, before retrying */
+    void (*tx_commit)();
+    size_t (*conflict)(size_t owner); /* cycles to wait for owner's lock (0: abort) */
+  } sstm_cm_t;
+
+  /* published priority of every thread (higher wins), and the futex
+     its waiters sleep on */
+  typedef struct sstm_cm_slot
+  {
+    volatile size_t prio;
+    volatile uint32_t sleepers;
+    volatile uint32_t released;	/* bumped when the thread releases its locks */
+    uint8_t padding[CACHE_LINE_SIZE - sizeof(size_t) - 2 * sizeof(uint32_t)];
+  } sstm_cm_slot_t;
+
+  extern const sstm_cm_t* sstm_cms[SSTM_CM_NUM];
+  extern sstm_cm_slot_t sstm_cm_slots[SSTM_CM_MAX_THREADS];
+
+  /* sleeps (for SSTM_PARK_SLICE_US at most) until owner releases its
+     locks, unless the orec has changed already
+  */
+  static inline void
+  sstm_cm_park(size_t owner, volatile uintptr_t* orec, uintptr_t o)
+  {
+    const struct timespec slice = { 0, SSTM_PARK_SLICE_US * 1000 };
+    sstm_cm_slot_t* slot = &sstm_cm_slots[owner & (SSTM_CM_MAX_THREADS - 1)];
+    __sync_fetch_and_add(&slot->sleepers, 1);
+    uint32_t released = slot->released;
+    if (*orec == o)
+      {
+	futex_wait(&slot->released, released, &slice);
+      }
+    __sync_fetch_and_sub(&slot->sleepers, 1);
+  }
+
+  /* called once the TX has released its locks (commit or abort) */
+  static inline void
+  sstm_cm_wake()
+  {
+    sstm_cm_slot_t* slot = &sstm_cm_slots[sstm_meta.id & (SSTM_CM_MAX_THREADS - 1)];
+    if (__builtin_expect(slot->sleepers != 0, 0))
+      {
+	slot->released++;
+	futex_wake(&slot->released, INT_MAX);
+      }
+  }
+
+  /* waits for up to budget cycles for the orec to change; returns 1 if
+     it changed */
+  static inline int
+  sstm_cm_wait(volatile uintptr_t* orec, uintptr_t o, uint64_t budget)
+  {
+    uint64_t park_after = sstm_meta_global.park_after;
+    uint64_t start = getticks();
+    while (*orec == o)
+      {
+	uint64_t waited = getticks() - start;
+	if (waited > budget)
+	  {
+	    return 0;
+	  }
+	if (park_after != 0 && waited > park_after)
+	  {
+	    sstm_cm_park(OREC_OWNER(o), orec, o);
+	  }
+	else
+	  {
+	    PAUSE();
+	  }
+      }
+    return 1;
+  }
+
+  /* the orec is locked by another TX: waits for it to change as long as
+     the contention manager allows. returns 1 if it changed (the access
+     can be retried), 0 if the TX must abort right away; aborts with
+     SSTM_ABORT_LOCK_TIMEOUT if it waited in vain
+  */
+  static inline int
+  sstm_cm_conflict(sstm_orec_t* orec, uintptr_t o)
+  {
+    sstm_meta.cm_enemy = orec;
+    sstm_meta.cm_enemy_orec = o;
+
+    size_t budget = sstm_meta_global.cm->conflict(OREC_OWNER(o));
+    if (budget == 0)
+      {
+	return 0;
+      }
+
+    if (!sstm_cm_wait(orec, o, budget))
+      {
+	sstm_tx_abort(SSTM_ABORT_LOCK_TIMEOUT);
+      }
+    return 1;
+  }
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_CM_H_ */
@@ -0,0 +1,401 @@
+#ifndef _SSTM_LOG_H_
+#define	_SSTM_LOG_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sstm_orec.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_LOG_INIT_SIZE 64	/* write-set index buckets / 2 */
+#define SSTM_LOG_CHUNK_SIZE (16 * 1024) /* bytes */
+
+  /* **************************************************************************************************** */
+  /* per-thread transaction logs */
+  /* **************************************************************************************************** */
+
+  /* a log is a list of fixed-size chunks, filled in order. Chunks are
+     kept when the log is cleared, so a TX only allocates when it logs
+     more than any previous TX of the thread; entries never move. The
+     chunks are freed by sstm_log_destroy() */
+  typedef struct sstm_log_chunk
+  {
+    struct sstm_log_chunk* next;
+    struct sstm_log_chunk* prev;
+    char* end;			/* of the room for entries */
+    char entries[] __attribute__ ((aligned(64)));
+  } sstm_log_chunk_t;
+
+  typedef struct sstm_log
+  {
+    size_t n;			/* entries */
+    char* cur;			/* next free entry */
+    char* end;			/* of the current chunk */
+    sstm_log_chunk_t* chunk;	/* current chunk */
+    sstm_log_chunk_t* first;
+    size_t esize;		/* bytes per entry */
+    size_t cap;			/* entries per chunk */
+  } sstm_log_t;
+
+  /* entries of esize bytes, as many per chunk as fit */
+  extern void sstm_log_init(sstm_log_t* log, size_t esize);
+  /* at most cap entries per chunk (the rest of the chunk is left to the
+     owner of the log) */
+  extern void sstm_log_init_cap(sstm_log_t* log, size_t esize, size_t cap);
+  extern void sstm_log_destroy(sstm_log_t* log);
+  /* moves to the next chunk, allocating it if needed (aborts the TX with
+     SSTM_ABORT_CAPACITY if out of memory) */
+  extern void sstm_log_extend(sstm_log_t* log);
+
+  static inline void*
+  sstm_log_add(sstm_log_t* log)
+  {
+    if (__builtin_expect(log->cur == log->end, 0))
+      {
+	sstm_log_extend(log);
+      }
+    void* e = log->cur;
+    log->cur += log->esize;
+    log->n++;
+    return e;
+  }
+
+  static inline void
+  sstm_log_clear(sstm_log_t* log)
+  {
+    log->n = 0;
+    log->chunk = log->first;
+    log->cur = log->first->entries;
+    log->end = log->first->end;
+  }
+
+  static inline char*
+  sstm_log_chunk_end(const sstm_log_t* log, const sstm_log_chunk_t* c)
+  {
+    return c == log->chunk ? log->cur : c->end;
+  }
+
+  /* iterates over the entries (of the given type) in log order, or in
+     reverse order. The body must not break (it would only end the
+     current chunk), but can return or continue */
+#define SSTM_LOG_FOREACH(log, type, e)					\
+  for (sstm_log_chunk_t* __c = (log)->first; __c != NULL;		\
+       __c = (__c == (log)->chunk) ? NULL : __c->next)			\
+    for (char* __end = sstm_log_chunk_end((log), __c); __end; __end = NULL) \
+      for (type* e = (type*) __c->entries; (char*) e < __end; e++)
+
+#define SSTM_LOG_FOREACH_REVERSE(log, type, e)				\
+  for (sstm_log_chunk_t* __c = (log)->n ? (log)->chunk : NULL; __c != NULL; \
+       __c = (__c == (log)->first) ? NULL : __c->prev)		\
+    for (type* e = (type*) sstm_log_chunk_end((log), __c);		\
+	 e-- > (type*) __c->entries; )
+
+  /* a position in a log, which the log can be truncated back to
+     (closed nesting) */
+  typedef struct sstm_log_pos
+  {
+    size_t n;
+    char* cur;
+    char* end;
+    sstm_log_chunk_t* chunk;
+  } sstm_log_pos_t;
+
+  static inline void
+  sstm_log_mark(const sstm_log_t* log, sstm_log_pos_t* pos)
+  {
+    pos->n = log->n;
+    pos->cur = log->cur;
+    pos->end = log->end;
+    pos->chunk = log->chunk;
+  }
+
+  /* forgets the entries added since pos was marked */
+  static inline void
+  sstm_log_rewind(sstm_log_t* log, const sstm_log_pos_t* pos)
+  {
+    log->n = pos->n;
+    log->cur = pos->cur;
+    log->end = pos->end;
+    log->chunk = pos->chunk;
+  }
+
+  /* iterates over the entries added since pos was marked, in log order
+     or in reverse order (same rules as SSTM_LOG_FOREACH) */
+#define SSTM_LOG_FOREACH_SINCE(log, pos, type, e)			\
+  for (sstm_log_chunk_t* __c = (log)->n > (pos)->n ? (pos)->chunk : NULL; \
+       __c != NULL; __c = (__c == (log)->chunk) ? NULL : __c->next)	\
+    for (char* __end = sstm_log_chunk_end((log), __c); __end; __end = NULL) \
+      for (type* e = (type*) (__c == (pos)->chunk ? (pos)->cur : __c->entries); \
+	   (char*) e < __end; e++)
+
+#define SSTM_LOG_FOREACH_REVERSE_SINCE(log, pos, type, e)		\
+  for (sstm_log_chunk_t* __c = (log)->n > (pos)->n ? (log)->chunk : NULL; \
+       __c != NULL; __c = (__c == (pos)->chunk) ? NULL : __c->prev)	\
+    for (type* e = (type*) sstm_log_chunk_end((log), __c),		\
+	   *__begin = (type*) (__c == (pos)->chunk ? (pos)->cur : __c->entries); \
+	 e-- > __begin; )
+
+  /* a read-set entry is a (word, observed value) pair: orec-based
+     algorithms log (orec, version), value-based ones (address, value).
+     The read set stores them as a structure of arrays, so validation
+     can check several entries per vector instruction (see
+     sstm_validate.h): every chunk holds SSTM_READ_SET_CHUNK words, then
+     the SSTM_READ_SET_CHUNK values (the log only sees the words) */
+#define SSTM_READ_SET_CHUNK						\
+  (((SSTM_LOG_CHUNK_SIZE - sizeof(sstm_log_chunk_t)) / (2 * sizeof(uintptr_t))) & ~7UL)
+
+  typedef sstm_log_t sstm_read_set_t;
+
+  typedef struct sstm_write_entry
+  {
+    volatile uintptr_t* addr;
+    uintptr_t val;
+    sstm_orec_t* orec;
+    size_t locked;		/* did this entry acquire its orec */
+  } sstm_write_entry_t;
+
+  /* undo log of write-through algorithms: (address, old value) entries,
+     appended in program order */
+  typedef sstm_log_t sstm_undo_log_t;
+
+  /* write set: the entries in program order (for write-back) plus an
+     open-addressed hash index keyed by address. Index buckets are
+     valid only if they carry the current generation, so clearing the
+     write set is a generation increment instead of a memset. A 64-bit
+     Bloom filter answers "never written" with a single bit test. */
+  typedef struct sstm_write_index
+  {
+    volatile uintptr_t* addr;
+    sstm_write_entry_t* entry;
+    uint32_t gen;
+  } sstm_write_index_t;
+
+  typedef struct sstm_write_set
+  {
+    sstm_log_t log;		/* of sstm_write_entry_t */
+    uintptr_t bloom;
+    uint32_t gen;
+    size_t index_mask;
+    sstm_write_index_t* index;
+  } sstm_write_set_t;
+
+
+  static inline void
+  sstm_read_set_init(sstm_read_set_t* rs)
+  {
+    sstm_log_init_cap(rs, sizeof(uintptr_t), SSTM_READ_SET_CHUNK);
+  }
+
+  static inline void
+  sstm_read_set_destroy(sstm_read_set_t* rs)
+  {
+    sstm_log_destroy(rs);
+  }
+
+  static inline void
+  sstm_read_set_add(sstm_read_set_t* rs, volatile uintptr_t* addr, uintptr_t val)
+  {
+    volatile uintptr_t** w = (volatile uintptr_t**) sstm_log_add(rs);
+    *w = addr;
+    ((uintptr_t*) w)[SSTM_READ_SET_CHUNK] = val;
+  }
+
+  /* the words and the values of read-set chunk c, and how many there are */
+  static inline volatile uintptr_t* const*
+  sstm_read_set_words(const sstm_log_chunk_t* c)
+  {
+    return (volatile uintptr_t* const*) c->entries;
+  }
+
+  static inline const uintptr_t*
+  sstm_read_set_vals(const sstm_log_chunk_t* c)
+  {
+    return (const uintptr_t*) c->entries + SSTM_READ_SET_CHUNK;
+  }
+
+  static inline size_t
+  sstm_read_set_chunk_n(const sstm_read_set_t* rs, const sstm_log_chunk_t* c)
+  {
+    return (sstm_log_chunk_end(rs, c) - c->entries) / sizeof(uintptr_t);
+  }
+
+  /* iterates over the chunks of the read set */
+#define SSTM_READ_SET_FOREACH_CHUNK(rs, c)				\
+  for (const sstm_log_chunk_t* c = (rs)->first; c != NULL;		\
+       c = (c == (rs)->chunk) ? NULL : c->next)
+
+  static inline void
+  sstm_undo_log_init(sstm_undo_log_t* ul)
+  {
+    sstm_log_init(ul, sizeof(sstm_write_entry_t));
+  }
+
+  static inline void
+  sstm_undo_log_destroy(sstm_undo_log_t* ul)
+  {
+    sstm_log_destroy(ul);
+  }
+
+  static inline sstm_write_entry_t*
+  sstm_undo_log_add(sstm_undo_log_t* ul)
+  {
+    return (sstm_write_entry_t*) sstm_log_add(ul);
+  }
+
+
+  static inline uintptr_t
+  sstm_write_set_bloom_bit(volatile uintptr_t* addr)
+  {
+    return 1UL << (((uintptr_t) addr >> 3) & 63);
+  }
+
+  static inline size_t
+  sstm_write_set_hash(volatile uintptr_t* addr)
+  {
+    return (((uintptr_t) addr >> 3) * 0x9E3779B97F4A7C15UL) >> 32;
+  }
+
+  static inline void
+  sstm_write_set_init(sstm_write_set_t* ws)
+  {
+    sstm_log_init(&ws->log, sizeof(sstm_write_entry_t));
+    ws->bloom = 0;
+    ws->gen = 1;
+    ws->index_mask = 2 * SSTM_LOG_INIT_SIZE - 1;
+    ws->index = (sstm_write_index_t*) calloc(ws->index_mask + 1, sizeof(sstm_write_index_t));
+    assert(ws->index != NULL);
+  }
+
+  static inline void
+  sstm_write_set_destroy(sstm_write_set_t* ws)
+  {
+    sstm_log_destroy(&ws->log);
+    free(ws->index);
+    ws->index = NULL;
+  }
+
+  /* empties the write set in O(1) */
+  static inline void
+  sstm_write_set_clear(sstm_write_set_t* ws)
+  {
+    if (ws->log.n > 0)
+      {
+	sstm_log_clear(&ws->log);
+	ws->bloom = 0;
+	if (__builtin_expect(++ws->gen == 0, 0))
+	  {
+	    memset(ws->index, 0, (ws->index_mask + 1) * sizeof(sstm_write_index_t));
+	    ws->gen = 1;
+	  }
+      }
+  }
+
+  static inline void
+  sstm_write_set_index_put(sstm_write_set_t* ws, sstm_write_entry_t* w)
+  {
+    size_t b = sstm_write_set_hash(w->addr) & ws->index_mask;
+    while (ws->index[b].gen == ws->gen)
+      {
+	b = (b + 1) & ws->index_mask;
+      }
+    ws->index[b].addr = w->addr;
+    ws->index[b].entry = w;
+    ws->index[b].gen = ws->gen;
+  }
+
+  /* doubles the index, which is kept at most half full, rehashing
+     with a fresh generation */
+  static inline void
+  sstm_write_set_grow(sstm_write_set_t* ws)
+  {
+    free(ws->index);
+    ws->index_mask = 2 * ws->index_mask + 1;
+    ws->index = (sstm_write_index_t*) calloc(ws->index_mask + 1, sizeof(sstm_write_index_t));
+    assert(ws->index != NULL);
+    ws->gen = 1;
+    SSTM_LOG_FOREACH(&ws->log, sstm_write_entry_t, w)
+      {
+	sstm_write_set_index_put(ws, w);
+      }
+  }
+
+  /* forgets the entries added since pos was marked (the entries that
+     were there already keep their current value) */
+  static inline void
+  sstm_write_set_rewind(sstm_write_set_t* ws, const sstm_log_pos_t* pos)
+  {
+    if (ws->log.n == pos->n)
+      {
+	return;
+      }
+    sstm_log_rewind(&ws->log, pos);
+    ws->bloom = 0;
+    if (__builtin_expect(++ws->gen == 0, 0))
+      {
+	memset(ws->index, 0, (ws->index_mask + 1) * sizeof(sstm_write_index_t));
+	ws->gen = 1;
+      }
+    SSTM_LOG_FOREACH(&ws->log, sstm_write_entry_t, w)
+      {
+	sstm_write_set_index_put(ws, w);
+	ws->bloom |= sstm_write_set_bloom_bit(w->addr);
+      }
+  }
+
+  /* returns the entry for addr, or NULL */
+  static inline sstm_write_entry_t*
+  sstm_write_set_find(sstm_write_set_t* ws, volatile uintptr_t* addr)
+  {
+    if (!(ws->bloom & sstm_write_set_bloom_bit(addr)))
+      {
+	return NULL;
+      }
+
+    size_t b = sstm_write_set_hash(addr) & ws->index_mask;
+    while (ws->index[b].gen == ws->gen)
+      {
+	if (ws->index[b].addr == addr)
+	  {
+	    return ws->index[b].entry;
+	  }
+	b = (b + 1) & ws->index_mask;
+      }
+    return NULL;
+  }
+
+  /* returns the entry for addr, adding a new one (with only addr set)
+     if there is none */
+  static inline sstm_write_entry_t*
+  sstm_write_set_get(sstm_write_set_t* ws, volatile uintptr_t* addr, int* created)
+  {
+    sstm_write_entry_t* w = sstm_write_set_find(ws, addr);
+    if (w != NULL)
+      {
+	*created = 0;
+	return w;
+      }
+
+    if (__builtin_expect(2 * (ws->log.n + 1) > ws->index_mask + 1, 0))
+      {
+	sstm_write_set_grow(ws);
+      }
+
+    w = (sstm_write_entry_t*) sstm_log_add(&ws->log);
+    w->addr = addr;
+    sstm_write_set_index_put(ws, w);
+    ws->bloom |= sstm_write_set_bloom_bit(addr);
+    *created = 1;
+    return w;
+  }
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_LOG_H_ */
@@ -0,0 +1,77 @@
+#ifndef _SSTM_NUMA_H_
+#define	_SSTM_NUMA_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* CPU topology, thread placement and NUMA-local memory */
+  /* **************************************************************************************************** */
+
+  /*
+     The topology (online CPUs, their NUMA node, package and core) is
+     read from sysfs the first time it is needed. Memory is bound to a
+     node with mbind() (no libnuma); where the kernel does not allow it,
+     the calls do nothing.
+
+     Placement policies of benchmark threads (sstm_placement_set()):
+     none    : no affinity (default)
+     compact : fill a node before the next one, hyperthreads of a core
+               next to each other
+     scatter : round-robin over the nodes, one thread per core before
+               the second hyperthreads
+     a list  : the CPUs given, e.g. "0,2,8-15", in that order
+     Thread t gets the (t mod n)-th CPU of the resulting order.
+  */
+
+#define SSTM_NUMA_MAX_CPUS      1024
+#define SSTM_NUMA_MAX_NODES     64
+
+  typedef struct sstm_cpu
+  {
+    int cpu;
+    int node;
+    int package;
+    int core;
+  } sstm_cpu_t;
+
+  typedef struct sstm_topology
+  {
+    size_t n_cpus;		/* online */
+    size_t n_nodes;		/* with online CPUs */
+    size_t n_packages;
+    size_t n_cores;
+    sstm_cpu_t cpus[SSTM_NUMA_MAX_CPUS]; /* online, by CPU number */
+  } sstm_topology_t;
+
+  extern const sstm_topology_t* sstm_topology();
+  /* the node of cpu (-1 for no CPU) */
+  extern int sstm_numa_node_of_cpu(int cpu);
+  /* the node the calling thread is confined to by its affinity, or -1 */
+  extern int sstm_numa_thread_node();
+  /* prefers node for the pages of [addr, addr + len), and moves the
+     ones already touched; returns 0 on success */
+  extern int sstm_numa_bind(void* addr, size_t len, int node);
+  /* zeroed, page-aligned memory on node (anywhere if node < 0) */
+  extern void* sstm_numa_alloc(size_t size, int node);
+  extern void sstm_numa_free(void* mem, size_t size);
+
+  /* returns 0, or -1 if spec is not a policy or a valid CPU list */
+  extern int sstm_placement_set(const char* spec);
+  extern const char* sstm_placement_name();
+  /* the CPU of thread, or -1 without placement */
+  extern int sstm_placement_cpu(size_t thread);
+  /* pins the threads created with attr to the CPU of thread */
+  extern void sstm_placement_attr(pthread_attr_t* attr, size_t thread);
+  /* prints the topology and the CPU of each of the n threads */
+  extern void sstm_print_placement(size_t n);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_NUMA_H_ */
@@ -0,0 +1,85 @@
+#ifndef _SSTM_OREC_H_
+#define	_SSTM_OREC_H_
+
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* ownership records (orecs): a table of versioned locks, indexed by a hash of the address */
+  /* **************************************************************************************************** */
+
+  /*
+     An orec is a single word:
+     bit  0      : locked bit
+     bits 1..47  : version (the commit timestamp of the last writer)
+     bits 48..63 : id of the owner thread (only meaningful while locked)
+     The version is kept while the orec is locked, so that releasing the
+     lock on abort is a single store and the owner can still validate
+     its own reads against it.
+  */
+
+  /* defaults of the runtime knobs (see sstm_orecs_create()) */
+#define SSTM_OREC_BITS_DEFAULT  20 /* 2^20 orecs */
+#define SSTM_OREC_SHIFT_DEFAULT 3  /* one stripe per 8-byte word */
+#define SSTM_OREC_PAD_DEFAULT   0  /* packed, 8 orecs per cache line */
+
+#define SSTM_OREC_BITS_ENV      "SSTM_OREC_BITS"
+#define SSTM_OREC_STRIPE_ENV    "SSTM_OREC_STRIPE" /* "word", "line", or a shift */
+#define SSTM_OREC_PAD_ENV       "SSTM_OREC_PAD"
+
+#define OREC_LOCK_BIT           0x1UL
+#define OREC_OWNER_SHIFT        48
+#define OREC_VERSION_BITS       ((1UL << OREC_OWNER_SHIFT) - 2)
+
+#define OREC_IS_LOCKED(o)       ((o) & OREC_LOCK_BIT)
+#define OREC_VERSION(o)         (((o) & OREC_VERSION_BITS) >> 1)
+#define OREC_OWNER(o)           ((o) >> OREC_OWNER_SHIFT)
+#define OREC_MAKE(version)      ((uintptr_t) (version) << 1)
+#define OREC_LOCKED_BY(o, id)   (((o) & OREC_VERSION_BITS) | OREC_LOCK_BIT | ((uintptr_t) (id) << OREC_OWNER_SHIFT))
+#define OREC_UNLOCKED(o)        ((o) & OREC_VERSION_BITS)
+#define OREC_IS_OWNED_BY(o, id) (OREC_IS_LOCKED(o) && OREC_OWNER(o) == (id))
+
+  typedef volatile uintptr_t sstm_orec_t;
+
+  typedef struct sstm_orec_table
+  {
+    sstm_orec_t* orecs;
+    size_t mask;		/* number of orecs - 1 */
+    unsigned int shift;		/* log2 of the stripe size in bytes */
+    unsigned int stride;	/* log2 of the orec spacing in words (3: padded to a cache line) */
+    size_t bytes;		/* size of the mapping */
+  } sstm_orec_table_t;
+
+  static inline size_t
+  sstm_orec_index(const sstm_orec_table_t* t, volatile void* addr)
+  {
+    return ((uintptr_t) addr >> t->shift) & t->mask;
+  }
+
+  static inline sstm_orec_t*
+  sstm_orec_get(const sstm_orec_table_t* t, volatile void* addr)
+  {
+    return &t->orecs[sstm_orec_index(t, addr) << t->stride];
+  }
+
+  /* the number of words from addr to the end of its stripe, or to end
+     if that comes first (at least one) */
+  static inline size_t
+  sstm_orec_stripe_words(const sstm_orec_table_t* t, volatile uintptr_t* addr, volatile uintptr_t* end)
+  {
+    uintptr_t a = (uintptr_t) addr;
+    uintptr_t next = (a | ((1UL << t->shift) - 1)) + 1;
+    size_t k = (next - a + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+    size_t left = end - addr;
+    return k < left ? k : left;
+  }
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_OREC_H_ */
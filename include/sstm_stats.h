@@ -0,0 +1,164 @@
+#ifndef _SSTM_STATS_H_
+#define	_SSTM_STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* detailed statistics (in addition to the frozen sstm_print_stats()) */
+  /* **************************************************************************************************** */
+
+  /* abort reasons, passed to sstm_tx_abort() and through siglongjmp
+     (must be != 0); the argument of TX_ABORT() is not one of them */
+#define SSTM_ABORT_EXPLICIT     1 /* TX_ABORT() by the user (sstm_meta.abort_value) */
+#define SSTM_ABORT_RW_CONFLICT  2 /* read a location that is locked or too new */
+#define SSTM_ABORT_WW_CONFLICT  3 /* could not acquire a write lock */
+#define SSTM_ABORT_VALIDATION   4 /* read-set validation failed */
+#define SSTM_ABORT_RO_UPGRADE   5 /* store in a read-only TX: restart in update mode */
+#define SSTM_ABORT_SERIAL       6 /* TX_IRREVOCABLE(): restart in serial mode */
+#define SSTM_ABORT_LOCK_TIMEOUT 7 /* waited too long for a lock (contention manager) */
+#define SSTM_ABORT_CAPACITY     8 /* no memory to grow a log: restart in serial mode */
+#define SSTM_ABORT_SNAPSHOT     9 /* a version of the snapshot was dropped (mvcc) */
+#define SSTM_ABORT_NUM          10
+
+  /* sizes are counted in power-of-two buckets: bucket 0 holds 0,
+     bucket b > 0 holds [2^(b-1), 2^b) */
+#define SSTM_STATS_BUCKETS      24
+
+  /* every field is a size_t counter (see sstm_stats_merge()) */
+  typedef struct sstm_stats
+  {
+    size_t n_commits;
+    size_t n_commits_ro;	/* in read-only mode */
+    size_t n_commits_serial;	/* in serial mode */
+    size_t n_aborts;
+    size_t aborts[SSTM_ABORT_NUM]; /* by reason */
+    size_t n_aborts_nested;	/* that only rolled back a closed nested TX */
+    size_t retries;		/* aborts of committed TXs */
+    size_t retries_hist[SSTM_STATS_BUCKETS]; /* aborts before each commit */
+    size_t rset;		/* entries, update-mode commits only */
+    size_t rset_hist[SSTM_STATS_BUCKETS];
+    size_t wset;
+    size_t wset_hist[SSTM_STATS_BUCKETS];
+  } sstm_stats_t;
+
+  /* latency (begin of the first attempt to commit, in getticks() cycles)
+     in a log-linear histogram: values below 2^SSTM_LAT_SUB_BITS have
+     their own bucket, larger ones 2^SSTM_LAT_SUB_BITS buckets per power
+     of two (i.e., a relative error below 1/2^SSTM_LAT_SUB_BITS) */
+#define SSTM_LAT_SUB_BITS       4
+#define SSTM_LAT_SUB            (1 << SSTM_LAT_SUB_BITS)
+#define SSTM_LAT_BUCKETS        ((64 - SSTM_LAT_SUB_BITS + 1) * SSTM_LAT_SUB)
+
+  typedef struct sstm_latency
+  {
+    size_t n;
+    size_t sum;
+    size_t max;
+    size_t hist[SSTM_LAT_BUCKETS];
+  } sstm_latency_t;
+
+  static inline size_t
+  sstm_latency_bucket(uint64_t v)
+  {
+    if (v < SSTM_LAT_SUB)
+      {
+	return v;
+      }
+    size_t e = 63 - __builtin_clzl(v);
+    return (e - SSTM_LAT_SUB_BITS + 1) * SSTM_LAT_SUB + ((v >> (e - SSTM_LAT_SUB_BITS)) & (SSTM_LAT_SUB - 1));
+  }
+
+  /* the smallest value of a bucket */
+  static inline uint64_t
+  sstm_latency_bucket_value(size_t b)
+  {
+    if (b < SSTM_LAT_SUB)
+      {
+	return b;
+      }
+    size_t e = b / SSTM_LAT_SUB + SSTM_LAT_SUB_BITS - 1;
+    return (uint64_t) (SSTM_LAT_SUB + b % SSTM_LAT_SUB) << (e - SSTM_LAT_SUB_BITS);
+  }
+
+  static inline void
+  sstm_latency_add(sstm_latency_t* l, uint64_t v)
+  {
+    l->n++;
+    l->sum += v;
+    if (v > l->max)
+      {
+	l->max = v;
+      }
+    l->hist[sstm_latency_bucket(v)]++;
+  }
+
+  /* per-site profile: TXs are accounted to the TX_START() that began them */
+  typedef struct sstm_site_stats
+  {
+    size_t n_commits;
+    size_t n_aborts;
+    size_t cycles;		/* from the first attempt to the commit */
+    size_t rset;
+    size_t wset;
+  } sstm_site_stats_t;
+
+  /* the static descriptor of a TX_START() site */
+  typedef struct sstm_site
+  {
+    volatile uint8_t state;	/* SSTM_SITE_UNKNOWN/RO/RW, see sstm.h */
+    const char* file;
+    int line;
+    const char* func;
+    const char* label;		/* TX_START_LABEL(), or NULL */
+    volatile size_t id;		/* > 0 once registered */
+    struct sstm_site* next;	/* registered sites */
+    sstm_site_stats_t stats;	/* threads that have stopped */
+  } sstm_site_t;
+
+#define SSTM_PROFILE_ENV        "SSTM_PROFILE" /* print the site report at TM_STOP() */
+
+  static inline size_t
+  sstm_stats_bucket(size_t n)
+  {
+    size_t b = n ? 64 - __builtin_clzl(n) : 0;
+    return b < SSTM_STATS_BUCKETS ? b : SSTM_STATS_BUCKETS - 1;
+  }
+
+  /* adds a thread's statistics to the global ones (at sstm_thread_stop()) */
+  extern void sstm_stats_merge(const sstm_stats_t* stats);
+  extern void sstm_stats_reset();
+  extern void sstm_latency_merge(const sstm_latency_t* lat);
+  /* statistics of the calling thread */
+  extern const sstm_stats_t* sstm_thread_stats();
+  /* statistics of the threads that called sstm_thread_stop() */
+  extern const sstm_stats_t* sstm_global_stats();
+  extern const char* sstm_abort_reason_name(int reason);
+  extern const sstm_latency_t* sstm_thread_latency();
+  extern const sstm_latency_t* sstm_global_latency();
+  /* the latency (in cycles) below which fraction p (e.g., 0.999) of the
+     transactions committed, at the histogram resolution */
+  extern uint64_t sstm_latency_percentile(const sstm_latency_t* lat, double p);
+  /* estimated getticks() cycles per microsecond */
+  extern double sstm_ticks_per_us();
+  /* gives the site an id and adds it to the list of sites */
+  extern void sstm_site_register(sstm_site_t* site);
+  /* the calling thread's counters for a (registered) site */
+  extern sstm_site_stats_t* sstm_site_stats_get(sstm_site_t* site);
+  extern void sstm_site_stats_merge();
+  /* prints the sites ranked by the cycles spent in their TXs */
+  extern void sstm_print_site_stats();
+  /* prints the aborts by reason, the read- and write-set size
+     distributions, the retries per commit, and the latency percentiles */
+  extern void sstm_print_detailed_stats(double dur_s);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_STATS_H_ */
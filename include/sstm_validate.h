@@ -0,0 +1,96 @@
+#ifndef _SSTM_VALIDATE_H_
+#define	_SSTM_VALIDATE_H_
+
+#include "sstm.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* **************************************************************************************************** */
+  /* read-set validation kernels (selected with SSTM_VALIDATE) */
+  /* **************************************************************************************************** */
+
+  /*
+     scalar : one entry at a time
+     avx2   : 4 entries per iteration: the words are gathered with
+              vpgatherqq from the addresses of the read set, then checked
+              with vector compares (x86-64 CPUs with AVX2)
+
+     By default, avx2 is used if CPUID reports it, scalar otherwise.
+     Every kernel checks the n entries of one read-set chunk (the
+     addresses in words[], the values observed in vals[], see
+     sstm_log.h) and returns 1 if they all pass.
+  */
+
+  typedef enum sstm_validate_id
+    {
+      SSTM_VALIDATE_SCALAR,
+      SSTM_VALIDATE_AVX2,
+      SSTM_VALIDATE_NUM
+    } sstm_validate_id_t;
+
+#define SSTM_VALIDATE_ENV       "SSTM_VALIDATE"
+
+  typedef struct sstm_validate
+  {
+    const char* name;
+    int (*supported)();
+    /* every orec is unlocked (or locked by id) and not newer than ts (tl2) */
+    int (*versions)(volatile uintptr_t* const* words, size_t n, size_t id, size_t ts);
+    /* every orec still has the version observed, and is unlocked or
+       locked by id (tiny) */
+    int (*orecs)(volatile uintptr_t* const* words, const uintptr_t* vals, size_t n, size_t id);
+    /* every word still has the value observed (norec) */
+    int (*values)(volatile uintptr_t* const* words, const uintptr_t* vals, size_t n);
+  } sstm_validate_t;
+
+  extern const sstm_validate_t* sstm_validates[SSTM_VALIDATE_NUM];
+
+  /* the best kernel the CPU supports */
+  extern sstm_validate_id_t sstm_validate_default();
+
+  static inline int
+  sstm_validate_versions(const sstm_validate_t* v, const sstm_read_set_t* rs, size_t id, size_t ts)
+  {
+    SSTM_READ_SET_FOREACH_CHUNK(rs, c)
+      {
+	if (!v->versions(sstm_read_set_words(c), sstm_read_set_chunk_n(rs, c), id, ts))
+	  {
+	    return 0;
+	  }
+      }
+    return 1;
+  }
+
+  static inline int
+  sstm_validate_orecs(const sstm_validate_t* v, const sstm_read_set_t* rs, size_t id)
+  {
+    SSTM_READ_SET_FOREACH_CHUNK(rs, c)
+      {
+	if (!v->orecs(sstm_read_set_words(c), sstm_read_set_vals(c), sstm_read_set_chunk_n(rs, c), id))
+	  {
+	    return 0;
+	  }
+      }
+    return 1;
+  }
+
+  static inline int
+  sstm_validate_values(const sstm_validate_t* v, const sstm_read_set_t* rs)
+  {
+    SSTM_READ_SET_FOREACH_CHUNK(rs, c)
+      {
+	if (!v->values(sstm_read_set_words(c), sstm_read_set_vals(c), sstm_read_set_chunk_n(rs, c)))
+	  {
+	    return 0;
+	  }
+      }
+    return 1;
+  }
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_VALIDATE_H_ */
@@ -1,79 +1,281 @@
 #!/bin/bash
 
+# Runs bank and ll over a sweep of STM backends, workloads and thread
+# counts. Every configuration gets warm-up runs (discarded), then
+# several measured runs; the throughput (commits/s) of the measured
+# runs is summarized by its median, mean, standard deviation and 95%
+# confidence interval of the mean (Student's t), and compared with the
+# first backend (the baseline). Results are CSV or JSON, one record per
+# configuration.
+#
+# flag column:
+#   ok      : the comparison with the baseline holds
+#   noisy   : the coefficient of variation (stddev / mean) is above -c
+#   overlap : the confidence interval overlaps the baseline's, so the
+#             speedup is not significant
+#   failed  : a run crashed or found an inconsistent result
+
+usage()
+{
+    cat <<EOF
+Usage: $0 [options...]
+
+Options:
+  -a <list>   STM backends, the first one is the baseline (default="gl \${ALGO:-tl2}")
+  -b <list>   workloads, as bench:args with commas between args, e.g. bank:-r20,-N8
+              (default="bank:-r100 bank:-r20 bank:-r0 ll:-u0 ll:-u20 ll:-u100")
+  -t <list>   thread counts (default: powers of 2 up to nproc, and nproc)
+  -r <int>    measured runs per configuration (default=5)
+  -W <int>    warm-up runs per configuration (default=1)
+  -d <float>  duration of each run in seconds (default=1)
+  -p <string> thread placement, passed to bank and ll (default=none)
+  -c <float>  coefficient of variation above which a result is noisy (default=0.05)
+  -f <format> csv or json (default=csv)
+  -o <file>   output file (default: standard output)
+  -s          skip compilation
+  -h          print this message
+EOF
+}
+
+algos="gl ${ALGO:-tl2}";
+workloads="bank:-r100 bank:-r20 bank:-r0 ll:-u0 ll:-u20 ll:-u100";
+threads="";
+reps=5;
+warmup=1;
 duration=1;
+placement=none;
+max_cv=0.05;
+format=csv;
+output="";
+compile=1;
+
+while getopts "a:b:t:r:W:d:p:c:f:o:sh" opt;
+do
+    case $opt in
+	a) algos=$OPTARG;;
+	b) workloads=$OPTARG;;
+	t) threads=$OPTARG;;
+	r) reps=$OPTARG;;
+	W) warmup=$OPTARG;;
+	d) duration=$OPTARG;;
+	p) placement=$OPTARG;;
+	c) max_cv=$OPTARG;;
+	f) format=$OPTARG;;
+	o) output=$OPTARG;;
+	s) compile=0;;
+	h) usage; exit 0;;
+	*) usage; exit 1;;
+    esac;
+done;
 
-if [ $# -eq 0 ]
+if [ "$format" != csv ] && [ "$format" != json ];
 then
-    echo "// pass any parameter to the script to skip compilation.."
-    ./scripts/create_glstm.sh;
+    echo "!! ERROR: unknown format $format (csv or json)" >&2;
+    exit 1;
 fi;
 
-if [ $? -eq 1 ];
+if [ $reps -lt 2 ];
 then
-    echo "!! ERROR: could not create the necessary executables for benchmarking";
+    echo "!! ERROR: at least 2 measured runs are needed for a confidence interval" >&2;
     exit 1;
 fi;
 
-nc=$(nproc);
-
-b0="bank_glstm"
-b1="bank"
-
-l0="ll_glstm"
-l1="ll"
+if [ $compile -eq 1 ];
+then
+    echo "// compiling (-s skips it)" >&2;
+    make clean &> /dev/null;
+    if ! make > /dev/null 2>&1;
+    then
+	echo "!! ERROR: could not create the necessary executables for benchmarking" >&2;
+	exit 1;
+    fi;
+fi;
 
+nc=$(nproc);
+if [ -z "$threads" ];
+then
+    for ((i = 1; i < $nc; i *= 2))
+    do
+	threads="$threads $i";
+    done;
+    threads="$threads $nc";
+fi;
 
-workloads="-r100 -r20 -r0";
+# one line per measured run: bench, args, algo, threads, commits/s (-1: failed)
+runs=$(mktemp);
+trap "rm -f $runs" EXIT;
 
-rt=0;
-ri=0;
+# commits/s of one run, or -1 if it failed
+run()
+{
+    local algo=$1 bench=$2 args=$3 n=$4 out;
+    out=$(env SSTM_ALGO=$algo ./$bench $args -n$n -d$duration -p $placement 2>&1);
+    if [ $? -ne 0 ] || echo "$out" | grep -q "must always be 0\|is wrong\|Got a bank total";
+    then
+	echo -1;
+    else
+	echo "$out" | awk '/^# Commits:/ { print $5 }';
+    fi;
+}
 
-echo "## Bank ##################################";
 for w in $workloads;
 do
-    echo "# workload: $w";
-    echo "#Thrd Throughput-gl Throughput-yours Ratio"
-    for ((i = 1; i <= $nc; i++))
+    bench=${w%%:*};
+    args=${w#*:};
+    args=${args//,/ };
+    for n in $threads;
     do
-	ri=$(($ri+1));
-	printf "%-5d " $i;
-	thr0=$(./$b0 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
-	printf "%-13d " $thr0;
-	thr1=$(./$b1 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
-	printf "%-16d " $thr1;
-	ratio=$(echo $thr1/$thr0 | bc -l);
-	printf "%-7.2f\n" $ratio;
-	rt=$(echo "$rt+$ratio" | bc -l);
+	for algo in $algos;
+	do
+	    echo "# $bench $args, $n threads, $algo" >&2;
+	    for ((r = 0; r < $warmup; r++))
+	    do
+		run $algo $bench "$args" $n > /dev/null;
+	    done;
+	    for ((r = 0; r < $reps; r++))
+	    do
+		printf "%s\t%s\t%s\t%d\t%s\n" $bench "$args" $algo $n $(run $algo $bench "$args" $n) >> $runs;
+	    done;
+	done;
     done;
 done;
 
-workloads="-u0 -u20 -u100";
+if [ -n "$output" ];
+then
+    exec > $output;
+fi;
 
-echo "## LL ####################################";
-for w in $workloads;
-do
-    echo "# workload: $w";
-    echo "#Thrd Throughput-gl Throughput-yours Ratio"
-    for ((i = 1; i <= $nc; i++))
-    do
-	ri=$(($ri+1));
-	printf "%-5d " $i;
-	thr0=$(./$l0 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
-	printf "%-13d " $thr0;
-	thr1=$(./$l1 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
-	printf "%-16d " $thr1;
-	ratio=$(echo $thr1/$thr0 | bc -l);
-	printf "%-7.2f\n" $ratio;
-	rt=$(echo "$rt+$ratio" | bc -l);
-    done;
-done;
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown);
+baseline=${algos%% *};
+
+awk -F '\t' -v format=$format -v max_cv=$max_cv -v baseline=$baseline \
+    -v commit=$commit -v date="$(date -u +%Y-%m-%dT%H:%M:%SZ)" -v host="$(hostname)" -v nproc=$nc \
+    -v reps=$reps -v warmup=$warmup -v duration=$duration -v placement=$placement '
+# two-sided 95% quantiles of Student t, by degrees of freedom
+function t95(df)
+{
+    split("12.706 4.303 3.182 2.776 2.571 2.447 2.365 2.306 2.262 2.228 2.201 2.179 2.160 2.145 2.131 " \
+	  "2.120 2.110 2.101 2.093 2.086 2.080 2.074 2.069 2.064 2.060 2.056 2.052 2.048 2.045 2.042", t, " ");
+    return df <= 30 ? t[df] : 1.96;
+}
+
+{
+    key = $1 SUBSEP $2 SUBSEP $4;
+    cfg = key SUBSEP $3;
+    if (!(cfg in n))
+    {
+	order[++ncfg] = cfg;
+    }
+    if ($5 < 0)
+    {
+	failed[cfg] = 1;
+    }
+    v[cfg, n[cfg]++] = $5;
+}
+
+END {
+    for (c = 1; c <= ncfg; c++)
+    {
+	cfg = order[c];
+	k = n[cfg];
+	for (i = 0; i < k; i++)
+	{
+	    s[i] = v[cfg, i];
+	}
+	# insertion sort, for the median
+	for (i = 1; i < k; i++)
+	{
+	    x = s[i];
+	    for (j = i - 1; j >= 0 && s[j] > x; j--)
+	    {
+		s[j + 1] = s[j];
+	    }
+	    s[j + 1] = x;
+	}
+	median[cfg] = (k % 2) ? s[(k - 1) / 2] : (s[k / 2 - 1] + s[k / 2]) / 2;
+	min[cfg] = s[0];
+	max[cfg] = s[k - 1];
+	sum = 0;
+	for (i = 0; i < k; i++)
+	{
+	    sum += s[i];
+	}
+	mean[cfg] = sum / k;
+	ss = 0;
+	for (i = 0; i < k; i++)
+	{
+	    ss += (s[i] - mean[cfg]) ^ 2;
+	}
+	sd[cfg] = sqrt(ss / (k - 1));
+	half = t95(k - 1) * sd[cfg] / sqrt(k);
+	lo[cfg] = mean[cfg] - half;
+	hi[cfg] = mean[cfg] + half;
+	cv[cfg] = mean[cfg] > 0 ? sd[cfg] / mean[cfg] : 0;
+    }
+
+    if (format == "csv")
+    {
+	print "bench,args,algo,threads,runs,median,mean,stddev,cv,ci95_low,ci95_high,min,max,speedup,flag";
+    }
+    else
+    {
+	printf "{\n  \"commit\": \"%s\",\n  \"date\": \"%s\",\n  \"host\": \"%s\",\n  \"nproc\": %d,\n", commit, date, host, nproc;
+	printf "  \"runs\": %d,\n  \"warmup\": %d,\n  \"duration\": %s,\n  \"placement\": \"%s\",\n", reps, warmup, duration, placement;
+	printf "  \"baseline\": \"%s\",\n  \"results\": [", baseline;
+    }
+
+    for (c = 1; c <= ncfg; c++)
+    {
+	cfg = order[c];
+	split(cfg, f, SUBSEP);
+	base = f[1] SUBSEP f[2] SUBSEP f[3] SUBSEP baseline;
+	speedup = (base in median && median[base] > 0) ? median[cfg] / median[base] : 0;
+	if (cfg in failed || (base in failed))
+	{
+	    flag = "failed";
+	    speedup = 0;
+	}
+	else if (cv[cfg] > max_cv || (base in cv && cv[base] > max_cv))
+	{
+	    flag = "noisy";
+	}
+	else if (f[4] != baseline && (base in median) && lo[cfg] <= hi[base] && lo[base] <= hi[cfg])
+	{
+	    flag = "overlap";
+	}
+	else
+	{
+	    flag = "ok";
+	}
+
+	if (flag != "ok")
+	{
+	    printf "!! %s %s, %d threads, %s: %s\n", f[1], f[2], f[3], f[4], flag > "/dev/stderr";
+	}
+
+	if (format == "csv")
+	{
+	    printf "%s,\"%s\",%s,%d,%d,%.0f,%.0f,%.0f,%.4f,%.0f,%.0f,%.0f,%.0f,%.3f,%s\n",
+		f[1], f[2], f[4], f[3], n[cfg], median[cfg], mean[cfg], sd[cfg], cv[cfg],
+		lo[cfg], hi[cfg], min[cfg], max[cfg], speedup, flag;
+	}
+	else
+	{
+	    printf "%s\n    {\"bench\": \"%s\", \"args\": \"%s\", \"algo\": \"%s\", \"threads\": %d, \"runs\": %d, ",
+		(c > 1 ? "," : ""), f[1], f[2], f[4], f[3], n[cfg];
+	    printf "\"median\": %.0f, \"mean\": %.0f, \"stddev\": %.0f, \"cv\": %.4f, \"ci95\": [%.0f, %.0f], ",
+		median[cfg], mean[cfg], sd[cfg], cv[cfg], lo[cfg], hi[cfg];
+	    printf "\"min\": %.0f, \"max\": %.0f, \"speedup\": %.3f, \"flag\": \"%s\"}", min[cfg], max[cfg], speedup, flag;
+	}
+    }
+    if (format == "json")
+    {
+	printf "\n  ]\n}\n";
+    }
+}' $runs;
 
-bonus=$(echo "($rt/$ri) - 1" | bc -l);
-bl=$(echo "$bonus > 1" | bc -l);
-if [ $bl -eq 1 ];
+flagged=$(awk -F '\t' '$5 < 0' $runs | wc -l);
+if [ $flagged -gt 0 ];
 then
-    bonus=1;
+    echo "!! $flagged runs failed" >&2;
 fi;
-printf "~~> Bonus points = ~%.1f \n" $bonus;
-echo "(We will ofc run your code on a larger 40-core processor)";
-echo "(Make certain that it scales with the number of threads)";
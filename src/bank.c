@@ -4,15 +4,16 @@
 #include <signal.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "sstm.h"
 #include "random.h"
 __thread unsigned long* seeds; 
 
 /*
- * Useful macros to work with transactions. Note that, to use nested
- * transactions, one should check the environment returned by
- * stm_get_env() and only call sigsetjmp() if it is not null.
+ * Transactions can be nested: a TX_START() inside a transaction starts
+ * a nested transaction (flattened into its parent, or closed with
+ * SSTM_NESTING=closed, see sstm_nest.c), which is how -N runs transfer().
  */
 
 #define DEFAULT_DURATION                1
@@ -26,9 +27,13 @@ __thread unsigned long* seeds;
 #define DEFAULT_WRITE_THREADS           0
 #define DEFAULT_DISJOINT                0
 #define DEFAULT_VERBOSE                 0
+#define DEFAULT_LOAD_RANGE              0
+#define DEFAULT_NESTED                  1
 
 int delay = DEFAULT_DELAY;
 int test_verbose = DEFAULT_VERBOSE;
+int load_range = DEFAULT_LOAD_RANGE;
+int nested = DEFAULT_NESTED;
 int argc;
 char **argv;
 
@@ -57,6 +62,8 @@ typedef struct bank
 
 static bank_t* bank;
 
+#define TOTAL_CHUNK                     64 /* accounts copied at once by total() */
+
 int 
 transfer(account_t* src, account_t* dst, int amount) 
 {
@@ -76,6 +83,29 @@ transfer(account_t* src, account_t* dst, int amount)
   return amount;
 }
 
+/* n transfers of 1 between random accounts, as nested transactions
+   of a single transaction */
+int
+transfers(bank_t* bank, int n)
+{
+  int k;
+
+  TX_START();
+  for (k = 0; k < n; k++)
+    {
+      uint32_t src = fast_rand() % bank->size;
+      uint32_t dst = fast_rand() % bank->size;
+      if (dst == src)
+	{
+	  dst = ((src + 1) % bank->size);
+	}
+      transfer(bank->accounts + src, bank->accounts + dst, 1);
+    }
+  TX_COMMIT();
+
+  return n;
+}
+
 void
 check_accs(account_t* acc1, account_t* acc2) 
 {
@@ -83,7 +113,7 @@ check_accs(account_t* acc1, account_t* acc2)
 
   volatile int i, j;
 
-  TX_START();
+  TX_START_RO();
   i = TX_LOAD(&acc1->balance);
   j = TX_LOAD(&acc2->balance);
   TX_COMMIT();
@@ -109,11 +139,28 @@ total(bank_t* bank, int transactional)
     }
   else
     {
-      TX_START();
+      TX_START_RO();
       total = 0;
-      for (i = 0; i < bank->size; i++)
+      if (!load_range)
 	{
-	  total += TX_LOAD(&bank->accounts[i].balance);
+	  for (i = 0; i < bank->size; i++)
+	    {
+	      total += TX_LOAD(&bank->accounts[i].balance);
+	    }
+	}
+      else
+	{
+	  /* copy the accounts a chunk at a time: their stripes are checked once */
+	  account_t accs[TOTAL_CHUNK];
+	  for (i = 0; i < bank->size; i += TOTAL_CHUNK)
+	    {
+	      int j, n = bank->size - i < TOTAL_CHUNK ? bank->size - i : TOTAL_CHUNK;
+	      TX_LOAD_RANGE(accs, &bank->accounts[i], n * sizeof(account_t));
+	      for (j = 0; j < n; j++)
+		{
+		  total += accs[j].balance;
+		}
+	    }
 	}
       TX_COMMIT();
     }
@@ -156,12 +203,16 @@ typedef struct thread_data
   int32_t read_all;
   int32_t write_all;
   int32_t check;
-  size_t duration;
+  double duration;
+  uint64_t start;		/* TSC, when it left the start barrier */
+  uint64_t stop;		/* TSC, when it saw the end of the run */
   uint32_t nb_accounts;
 } thread_data_t;
 
 
 volatile int work = 1;
+/* the workers and main: the run starts once every thread is ready */
+pthread_barrier_t start_barrier;
 
 void*
 test(void *data) 
@@ -183,6 +234,8 @@ test(void *data)
 
   TM_THREAD_START();
 
+  pthread_barrier_wait(&start_barrier);
+  d->start = getticks();
   while(work)
     {
       uint8_t nb = fast_rand() & 127;
@@ -207,6 +260,10 @@ test(void *data)
 	      check_accs(bank_local->accounts + src, bank_local->accounts + dst);
 	      d->nb_checks++;
 	    }
+	  else if (nested > 1)
+	    {
+	      d->nb_transfer += transfers(bank_local, nested);
+	    }
 	  else
 	    {
 	      transfer(bank_local->accounts + src, bank_local->accounts + dst, 1);
@@ -214,6 +271,7 @@ test(void *data)
 	    }
 	}
     }
+  d->stop = getticks();
 
   TM_THREAD_STOP();
 
@@ -234,12 +292,16 @@ main(int argc, char **argv)
       {"read-all-rate", required_argument, NULL, 'r'},
       {"check", required_argument, NULL, 'c'},
       {"read-threads", required_argument, NULL, 'R'},
+      {"contention-manager", required_argument, NULL, 'm'},
+      {"load-range", no_argument, NULL, 'l'},
+      {"nested", required_argument, NULL, 'N'},
+      {"placement", required_argument, NULL, 'p'},
       {"verbose", no_argument, NULL, 'v'},
       {NULL, 0, NULL, 0}
     };
 
 
-  static int duration;
+  static double duration;
   static int nb_accounts;
   static int read_all;
   static int read_cores;
@@ -261,7 +323,7 @@ main(int argc, char **argv)
   while (1)
     {
       i = 0;
-      c = getopt_long(argc, argv, "hn:a:d:r:c:R:v", long_options, &i);
+      c = getopt_long(argc, argv, "hn:a:d:r:c:R:m:lN:p:v", long_options, &i);
 
       if (c == -1)
 	break;
@@ -297,6 +359,14 @@ main(int argc, char **argv)
 		 "        Percentage of read-all transactions (default=" XSTR(DEFAULT_READ_ALL) ")\n"
 		 "  -R, --read-threads <int>\n"
 		 "        Number of threads issuing only read-all transactions (default=" XSTR(DEFAULT_READ_THREADS) ")\n"
+		 "  -m, --contention-manager <string>\n"
+		 "        Contention manager: none, backoff, karma, greedy, timestamp (default=backoff)\n"
+		 "  -l, --load-range\n"
+		 "        Read-all transactions copy the accounts with TX_LOAD_RANGE() (pays off with SSTM_OREC_STRIPE=line)\n"
+		 "  -N, --nested <int>\n"
+		 "        Transfers per transaction, each a nested transaction (default=" XSTR(DEFAULT_NESTED) "; closed nesting with SSTM_NESTING=closed)\n"
+		 "  -p, --placement <string>\n"
+		 "        Thread placement: none, compact, scatter, or a CPU list such as 0,2,4-7 (default=none)\n"
 		 );
 	  exit(0);
 	case 'a':
@@ -306,7 +376,7 @@ main(int argc, char **argv)
 	  num_threads = atoi(optarg);
 	  break;
 	case 'd':
-	  duration = atoi(optarg);
+	  duration = atof(optarg);
 	  break;
 	case 'D':
 	  delay = atoi(optarg);
@@ -320,6 +390,26 @@ main(int argc, char **argv)
 	case 'R':
 	  read_cores = atoi(optarg);
 	  break;
+	case 'm':
+	  if (sstm_set_cm(optarg) != 0)
+	    {
+	      printf("Unknown contention manager: %s\n", optarg);
+	      exit(1);
+	    }
+	  break;
+	case 'l':
+	  load_range = 1;
+	  break;
+	case 'N':
+	  nested = atoi(optarg);
+	  break;
+	case 'p':
+	  if (sstm_placement_set(optarg) != 0)
+	    {
+	      printf("Unknown placement: %s\n", optarg);
+	      exit(1);
+	    }
+	  break;
 	case 'v':
 	  test_verbose = 1;
 	  break;
@@ -338,17 +428,20 @@ main(int argc, char **argv)
   write_all += read_all;
   check += write_all;
 
-  assert(duration >= 0);
+  assert(duration > 0);
   assert(nb_accounts >= 2);
+  assert(nested >= 1);
   assert(read_all >= 0 && write_all >= 0 && check >= 0 && check <= 100);
   
   if (test_verbose)
     {
       printf("Nb accounts    : %d\n", nb_accounts);
-      printf("Duration       : %ds\n", duration);
+      printf("Duration       : %gs\n", duration);
       printf("Check acc rate : %d\n", check - write_all);
       printf("Transfer rate  : %d\n", 100 - check);
+      printf("Nested         : %d (%s)\n", nested, getenv(SSTM_NESTING_ENV) ? getenv(SSTM_NESTING_ENV) : "flat");
       printf("# Read cores   : %d\n", read_cores);
+      sstm_print_placement(num_threads);
     }
   /* normalize percentages to 128 */
 
@@ -393,30 +486,36 @@ main(int argc, char **argv)
     }
 
 
-  thread_data_t data[num_threads];
+  thread_data_t* data[num_threads];
   pthread_t threads[num_threads];
   pthread_attr_t attr;
   int rc;
   void *status;
 
+  pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   long t;
   for(t = 0; t < num_threads; t++)
     {
-      data[t].id = t;
-      data[t].check = check;
-      data[t].read_all = read_all;
-      data[t].write_all = write_all;
-      data[t].read_cores = read_cores;
-      data[t].write_cores = write_cores;
-      data[t].nb_transfer = 0;
-      data[t].nb_checks = 0;
-      data[t].nb_read_all = 0;
-      data[t].nb_write_all = 0;
-      data[t].nb_accounts = bank->size;
-      data[t].duration = duration;
-      rc = pthread_create(&threads[t], &attr, test, &data[t]);
+      /* on the node of the thread, and on a page of its own */
+      data[t] = (thread_data_t*) sstm_numa_alloc(sizeof(thread_data_t), sstm_numa_node_of_cpu(sstm_placement_cpu(t)));
+      data[t]->id = t;
+      data[t]->check = check;
+      data[t]->read_all = read_all;
+      data[t]->write_all = write_all;
+      data[t]->read_cores = read_cores;
+      data[t]->write_cores = write_cores;
+      data[t]->nb_transfer = 0;
+      data[t]->nb_checks = 0;
+      data[t]->nb_read_all = 0;
+      data[t]->nb_write_all = 0;
+      data[t]->nb_accounts = bank->size;
+      data[t]->duration = duration;
+      data[t]->start = 0;
+      data[t]->stop = 0;
+      sstm_placement_attr(&attr, t);
+      rc = pthread_create(&threads[t], &attr, test, data[t]);
       if (rc)
 	{
 	  printf("ERROR; return code from pthread_create() is %d\n", rc);
@@ -428,8 +527,12 @@ main(int argc, char **argv)
   /* Free attribute and wait for the other threads */
   pthread_attr_destroy(&attr);
 
-  printf(" ZZZzzz %d seconds\n", duration);
-  sleep(duration);
+  pthread_barrier_wait(&start_barrier);
+  printf(" ZZZzzz %g seconds\n", duration);
+  struct timespec nap;
+  nap.tv_sec = (time_t) duration;
+  nap.tv_nsec = (long) ((duration - nap.tv_sec) * 1e9);
+  nanosleep(&nap, NULL);
   printf(" Woken up\n");
   asm volatile ("mfence");
   work = 0;
@@ -445,6 +548,21 @@ main(int argc, char **argv)
 	  exit(-1);
 	}
     }
+  pthread_barrier_destroy(&start_barrier);
+
+  /* the run is measured (TSC) from the first thread leaving the start
+     barrier to the last one seeing its end, so that thread creation and
+     the stop skew do not count; the TSC rate is the one seen since
+     TM_START() */
+  uint64_t first = UINT64_MAX, last = 0;
+  for(t = 0; t < num_threads; t++)
+    {
+      first = data[t]->start < first ? data[t]->start : first;
+      last = data[t]->stop > last ? data[t]->stop : last;
+    }
+  double tpu = sstm_ticks_per_us();
+  double measured = tpu > 0 ? (last - first) / (tpu * 1e6) : duration;
+  printf(" Measured %.6f seconds\n", measured);
 
   TM_STOP();
 
@@ -453,7 +571,7 @@ main(int argc, char **argv)
       for(t = 0; t < num_threads; t++)
 	{
 	  printf("---Core %ld\n  #transfer   : %zu\n  #checks     : %zu\n  #read-all   : %zu\n  #write-all  : %zu\n",
-		 t, data[t].nb_transfer, data[t].nb_checks, data[t].nb_read_all, data[t].nb_write_all);
+		 t, data[t]->nb_transfer, data[t]->nb_checks, data[t]->nb_read_all, data[t]->nb_write_all);
 	}
     }
 
@@ -467,8 +585,17 @@ main(int argc, char **argv)
     }
   assert(tot == 0);
 
-  TM_STATS(duration);
+  TM_STATS(measured);
+  if (test_verbose)
+    {
+      sstm_print_detailed_stats(measured);
+    }
+
 
+  for(t = 0; t < num_threads; t++)
+    {
+      sstm_numa_free(data[t], sizeof(thread_data_t));
+    }
 
   /* Delete bank and accounts */
   free(bank->accounts);
@@ -0,0 +1,193 @@
+#include <assert.h>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "sstm.h"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * Commit throughput of the global clock schemes: every thread runs
+ * small update transactions on its own (cache-line padded) counter,
+ * so the only shared location that commits contend on is the clock.
+ */
+
+#define DEFAULT_DURATION                1
+#define DEFAULT_NB_THREADS              1
+#define DEFAULT_CLOCKS                  "gv1,gv4,gv5,gv6,tsc"
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+typedef struct counter
+{
+  uintptr_t val;
+  uint8_t padding[CACHE_LINE_SIZE - sizeof(uintptr_t)];
+} counter_t;
+
+typedef struct thread_data
+{
+  uint64_t nb_commits;
+  uint64_t nb_aborts;
+  counter_t* counter;
+} thread_data_t;
+
+volatile int work = 1;
+
+void*
+test(void *data)
+{
+  thread_data_t *d = (thread_data_t *) data;
+  volatile uintptr_t* counter = &d->counter->val;
+
+  TM_THREAD_START();
+
+  while (work)
+    {
+      TX_START();
+      uintptr_t v = TX_LOAD(counter);
+      TX_STORE(counter, v + 1);
+      TX_COMMIT();
+      d->nb_commits++;
+    }
+
+  d->nb_aborts = sstm_meta.n_aborts;
+  TM_THREAD_STOP();
+
+  return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help", no_argument, NULL, 'h'},
+      {"num-threads", required_argument, NULL, 'n'},
+      {"duration", required_argument, NULL, 'd'},
+      {"clocks", required_argument, NULL, 'c'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int duration = DEFAULT_DURATION;
+  int num_threads = DEFAULT_NB_THREADS;
+  char* clocks = strdup(DEFAULT_CLOCKS);
+
+  int i, c;
+  while (1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hn:d:c:", long_options, &i);
+
+      if (c == -1)
+	break;
+
+      if (c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch (c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'h':
+	  printf("clock_bench -- commit throughput per global clock scheme\n"
+		 "\n"
+		 "Usage:\n"
+		 "  clock_bench [options...]\n"
+		 "\n"
+		 "Options:\n"
+		 "  -h, --help\n"
+		 "        Print this message\n"
+		 "  -n, --num-threads <int>\n"
+		 "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+		 "  -d, --duration <int>\n"
+		 "        Duration of each run in seconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+		 "  -c, --clocks <list>\n"
+		 "        Comma-separated clock schemes (default=" DEFAULT_CLOCKS ")\n"
+		 );
+	  exit(0);
+	case 'n':
+	  num_threads = atoi(optarg);
+	  break;
+	case 'd':
+	  duration = atoi(optarg);
+	  break;
+	case 'c':
+	  free(clocks);
+	  clocks = strdup(optarg);
+	  break;
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  assert(duration > 0);
+  assert(num_threads > 0);
+
+  counter_t* counters = (counter_t*) memalign(CACHE_LINE_SIZE, num_threads * sizeof(counter_t));
+  assert(counters != NULL);
+
+  printf("#%-6s %-8s %-14s %-14s\n", "Clock", "Threads", "Commits/s", "Aborts/s");
+
+  char* save;
+  char* name;
+  for (name = strtok_r(clocks, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save))
+    {
+      if (sstm_set_clock(name) != 0)
+	{
+	  /* e.g., tsc without an invariant TSC */
+	  printf("# %s: unknown or unsupported clock scheme, skipped\n", name);
+	  continue;
+	}
+
+      TM_START();
+
+      thread_data_t data[num_threads];
+      pthread_t threads[num_threads];
+      long t;
+      work = 1;
+      for (t = 0; t < num_threads; t++)
+	{
+	  counters[t].val = 0;
+	  data[t].nb_commits = 0;
+	  data[t].nb_aborts = 0;
+	  data[t].counter = &counters[t];
+	  if (pthread_create(&threads[t], NULL, test, &data[t]))
+	    {
+	      printf("ERROR; pthread_create()\n");
+	      exit(-1);
+	    }
+	}
+
+      sleep(duration);
+      asm volatile ("mfence");
+      work = 0;
+      asm volatile ("mfence");
+
+      uint64_t commits = 0, aborts = 0;
+      for (t = 0; t < num_threads; t++)
+	{
+	  pthread_join(threads[t], NULL);
+	  commits += data[t].nb_commits;
+	  aborts += data[t].nb_aborts;
+	  assert(counters[t].val == data[t].nb_commits);
+	}
+
+      TM_STOP();
+
+      printf("%-7s %-8d %-14.0f %-14.0f\n", sstm_clock_name(), num_threads,
+	     commits / (double) duration, aborts / (double) duration);
+    }
+
+  free(counters);
+  free(clocks);
+  return 0;
+}
@@ -4,15 +4,16 @@
 #include <signal.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "sstm.h"
 #include "random.h"
 __thread unsigned long* seeds; 
 
 /*
- * Useful macros to work with transactions. Note that, to use nested
- * transactions, one should check the environment returned by
- * stm_get_env() and only call sigsetjmp() if it is not null.
+ * Transactions can be nested: a TX_START() inside a transaction starts
+ * a nested transaction (flattened into its parent, or closed with
+ * SSTM_NESTING=closed, see sstm_nest.c).
  */
 
 #define DEFAULT_DURATION                1
@@ -130,7 +131,7 @@ ll_search(ll_t* list, size_t key)
 {
   int ret = 0;
 
-  TX_START();
+  TX_START_RO();
   node_t* cur = (node_t*) TX_LOAD(&list->head);
 
   while (cur != NULL && cur->key < key)
@@ -155,7 +156,7 @@ size_t
 ll_size(ll_t* list) 
 {
   size_t size = 0;
-  TX_START();
+  TX_START_RO();
   size = 0;
   node_t* cur = (node_t*) TX_LOAD(&list->head);
   while (cur != NULL)
@@ -184,12 +185,16 @@ typedef struct thread_data
   uint64_t nb_searchs_succ;
   int32_t id;
   int32_t perc_search;
-  size_t duration;
+  double duration;
+  uint64_t start;		/* TSC, when it left the start barrier */
+  uint64_t stop;		/* TSC, when it saw the end of the run */
   uint32_t size;
 } thread_data_t;
 
 
 volatile int work = 1;
+/* the workers and main: the run starts once every thread is ready */
+pthread_barrier_t start_barrier;
 
 void*
 test(void *data) 
@@ -208,7 +213,8 @@ test(void *data)
 
   TM_THREAD_START();
 
-  /* BARRIER; */
+  pthread_barrier_wait(&start_barrier);
+  d->start = getticks();
   while(work)
     {
       int op = (int) fast_rand();
@@ -230,6 +236,7 @@ test(void *data)
 	  d->nb_deletes++;
 	}
     }
+  d->stop = getticks();
 
   TM_THREAD_STOP();
 
@@ -244,21 +251,18 @@ main(int argc, char **argv)
       // These options don't set a flag
       {"help", no_argument, NULL, 'h'},
       {"num-threads", required_argument, NULL, 'n'},
-      {"accounts", required_argument, NULL, 'a'},
-      {"contention-manager", required_argument, NULL, 'c'},
+      {"initial", required_argument, NULL, 'i'},
       {"duration", required_argument, NULL, 'd'},
-      {"delay", required_argument, NULL, 'D'},
-      {"read-all-rate", required_argument, NULL, 'r'},
-      {"check", required_argument, NULL, 'c'},
-      {"read-threads", required_argument, NULL, 'R'},
-      {"write-all-rate", required_argument, NULL, 'w'},
-      {"write-threads", required_argument, NULL, 'W'},
+      {"update", required_argument, NULL, 'u'},
+      {"contention-manager", required_argument, NULL, 'c'},
+      {"placement", required_argument, NULL, 'p'},
       {"verbose", no_argument, NULL, 'v'},
       {NULL, 0, NULL, 0}
     };
 
 
-  static uint32_t duration, perc_updates, size, num_threads;
+  static double duration;
+  static uint32_t perc_updates, size, num_threads;
 
   duration = DEFAULT_DURATION;
   perc_updates = DEFAULT_PERC_UPDATES;
@@ -269,7 +273,7 @@ main(int argc, char **argv)
   while (1)
     {
       i = 0;
-      c = getopt_long(argc, argv, "hn:i:d:r:u::v", long_options, &i);
+      c = getopt_long(argc, argv, "hn:i:d:u::c:p:v", long_options, &i);
 
       if (c == -1)
 	break;
@@ -299,6 +303,10 @@ main(int argc, char **argv)
 		 "        Test duration in seconds (default=" XSTR(DEFAULT_DURATION) ")\n"
 		 "  -u, --update <int>\n"
 		 "        Percentage of update transactions (default=" XSTR(DEFAULT_PERC_UPDATES) ")\n"
+		 "  -c, --contention-manager <string>\n"
+		 "        Contention manager: none, backoff, karma, greedy, timestamp (default=backoff)\n"
+		 "  -p, --placement <string>\n"
+		 "        Thread placement: none, compact, scatter, or a CPU list such as 0,2,4-7 (default=none)\n"
 		 );
 	  exit(0);
 	case 'i':
@@ -308,11 +316,25 @@ main(int argc, char **argv)
 	  num_threads = atoi(optarg);
 	  break;
 	case 'd':
-	  duration = atoi(optarg);
+	  duration = atof(optarg);
 	  break;
 	case 'u':
 	  perc_updates = atoi(optarg);
 	  break;
+	case 'c':
+	  if (sstm_set_cm(optarg) != 0)
+	    {
+	      printf("Unknown contention manager: %s\n", optarg);
+	      exit(1);
+	    }
+	  break;
+	case 'p':
+	  if (sstm_placement_set(optarg) != 0)
+	    {
+	      printf("Unknown placement: %s\n", optarg);
+	      exit(1);
+	    }
+	  break;
 	case 'v':
 	  test_verbose = 1;
 	  break;
@@ -325,15 +347,16 @@ main(int argc, char **argv)
     }
 
 
-  assert(duration >= 0);
+  assert(duration > 0);
   assert(size >= 2);
   assert(perc_updates <= 100);
 
   if (test_verbose)
     {
       printf("Initial size   : %d\n", size);
-      printf("Duration       : %d s\n", duration);
+      printf("Duration       : %g s\n", duration);
       printf("Updates        : %d%%\n", perc_updates);
+      sstm_print_placement(num_threads);
     }
   /* normalize percentages to 128 */
 
@@ -363,28 +386,34 @@ main(int argc, char **argv)
     }
 
 
-  thread_data_t data[num_threads];
+  thread_data_t* data[num_threads];
   pthread_t threads[num_threads];
   pthread_attr_t attr;
   int rc;
   void *status;
 
+  pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   long t;
   for(t = 0; t < num_threads; t++)
     {
-      data[t].id = t;
-      data[t].nb_inserts = 0;
-      data[t].nb_deletes = 0;
-      data[t].nb_searchs = 0;
-      data[t].nb_inserts_succ = 0;
-      data[t].nb_deletes_succ = 0;
-      data[t].nb_searchs_succ = 0;
-      data[t].size = size; 
-      data[t].duration = duration;
-      data[t].perc_search = INT_MAX - perc_updates;
-      rc = pthread_create(&threads[t], &attr, test, &data[t]);
+      /* on the node of the thread, and on a page of its own */
+      data[t] = (thread_data_t*) sstm_numa_alloc(sizeof(thread_data_t), sstm_numa_node_of_cpu(sstm_placement_cpu(t)));
+      data[t]->id = t;
+      data[t]->nb_inserts = 0;
+      data[t]->nb_deletes = 0;
+      data[t]->nb_searchs = 0;
+      data[t]->nb_inserts_succ = 0;
+      data[t]->nb_deletes_succ = 0;
+      data[t]->nb_searchs_succ = 0;
+      data[t]->size = size; 
+      data[t]->duration = duration;
+      data[t]->start = 0;
+      data[t]->stop = 0;
+      data[t]->perc_search = INT_MAX - perc_updates;
+      sstm_placement_attr(&attr, t);
+      rc = pthread_create(&threads[t], &attr, test, data[t]);
       if (rc)
 	{
 	  printf("ERROR; return code from pthread_create() is %d\n", rc);
@@ -396,8 +425,12 @@ main(int argc, char **argv)
   /* Free attribute and wait for the other threads */
   pthread_attr_destroy(&attr);
 
-  printf(" ZZZzzz %d seconds\n", duration);
-  sleep(duration);
+  pthread_barrier_wait(&start_barrier);
+  printf(" ZZZzzz %g seconds\n", duration);
+  struct timespec nap;
+  nap.tv_sec = (time_t) duration;
+  nap.tv_nsec = (long) ((duration - nap.tv_sec) * 1e9);
+  nanosleep(&nap, NULL);
   printf(" Woken up\n");
   asm volatile ("mfence");
   work = 0;
@@ -413,30 +446,45 @@ main(int argc, char **argv)
 	  exit(-1);
 	}
     }
+  pthread_barrier_destroy(&start_barrier);
+
+  /* the run is measured (TSC) from the first thread leaving the start
+     barrier to the last one seeing its end, so that thread creation and
+     the stop skew do not count; the TSC rate is the one seen since
+     TM_START() */
+  uint64_t first = UINT64_MAX, last = 0;
+  for(t = 0; t < num_threads; t++)
+    {
+      first = data[t]->start < first ? data[t]->start : first;
+      last = data[t]->stop > last ? data[t]->stop : last;
+    }
+  double tpu = sstm_ticks_per_us();
+  double measured = tpu > 0 ? (last - first) / (tpu * 1e6) : duration;
+  printf(" Measured %.6f seconds\n", measured);
 
   size_t search_suc = 0, insert_suc = 0, delete_suc = 0,
     search_all = 0, insert_all = 0, delete_all = 0;
   for(t = 0; t < num_threads; t++)
     {
-      search_suc += data[t].nb_searchs_succ;
-      delete_suc += data[t].nb_deletes_succ;
-      insert_suc += data[t].nb_inserts_succ;
-      search_all += data[t].nb_searchs;
-      delete_all += data[t].nb_deletes;
-      insert_all += data[t].nb_inserts;
+      search_suc += data[t]->nb_searchs_succ;
+      delete_suc += data[t]->nb_deletes_succ;
+      insert_suc += data[t]->nb_inserts_succ;
+      search_all += data[t]->nb_searchs;
+      delete_all += data[t]->nb_deletes;
+      insert_all += data[t]->nb_inserts;
       if (test_verbose)
 	{
-	  double insert_suc_rate = 100 * data[t].nb_inserts_succ / (double) data[t].nb_inserts;
-	  double delete_suc_rate = 100 * data[t].nb_deletes_succ / (double) data[t].nb_deletes;
-	  double search_suc_rate = 100 * data[t].nb_searchs_succ / (double) data[t].nb_searchs;
+	  double insert_suc_rate = 100 * data[t]->nb_inserts_succ / (double) data[t]->nb_inserts;
+	  double delete_suc_rate = 100 * data[t]->nb_deletes_succ / (double) data[t]->nb_deletes;
+	  double search_suc_rate = 100 * data[t]->nb_searchs_succ / (double) data[t]->nb_searchs;
 	  printf("---Core %ld\n  #inserts   : %-10zu ( %-3.2f%% succ)\n"
 		 "  #deletes   : %-10zu ( %-3.2f%% succ)\n"
 		 "  #searches  : %-10zu ( %-3.2f%% succ)\n",
-		 t, data[t].nb_inserts, insert_suc_rate,
-		 data[t].nb_deletes, delete_suc_rate,
-		 data[t].nb_searchs,search_suc_rate);
+		 t, data[t]->nb_inserts, insert_suc_rate,
+		 data[t]->nb_deletes, delete_suc_rate,
+		 data[t]->nb_searchs,search_suc_rate);
 	  /* printf("  Successful\n  #inserts   : %zu\n  #deletes   : %zu\n  #searches  : %zu\n", */
-	  /* 	 data[t].nb_inserts_succ, data[t].nb_deletes_succ, data[t].nb_searchs_succ); */
+	  /* 	 data[t]->nb_inserts_succ, data[t]->nb_deletes_succ, data[t]->nb_searchs_succ); */
 	}
     }
 
@@ -465,9 +513,17 @@ main(int argc, char **argv)
 	 
 
 
-  TM_STATS(duration);
+  TM_STATS(measured);
+  if (test_verbose)
+    {
+      sstm_print_detailed_stats(measured);
+    }
   TM_THREAD_STOP();
   TM_STOP();
 
+  for (t = 0; t < num_threads; t++)
+    {
+      sstm_numa_free(data[t], sizeof(thread_data_t));
+    }
   free(list);
 }
@@ -0,0 +1,373 @@
+#include <assert.h>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "random.h"
+#include "lock_bench.h"
+__thread unsigned long* seeds;
+
+/*
+ * Lock handoff latency and fairness of the lock families of lock_if.h:
+ * every thread acquires a single lock in a loop, writes a few cache
+ * lines in the critical section, and works outside it for a while.
+ * A handoff is an acquisition by another thread than the last holder;
+ * its latency runs from the release (TSC) to the acquisition. The
+ * fairness is Jain's index of the acquisitions per thread (1: all
+ * equal, 1/n: one thread got them all). The critical section also
+ * counts the acquisitions with plain increments, as a check of mutual
+ * exclusion.
+ */
+
+#define DEFAULT_DURATION                1
+#define DEFAULT_NB_THREADS              4
+#define DEFAULT_CS_LINES                1 /* cache lines written in the critical section */
+#define DEFAULT_OUTSIDE                 256 /* cycles of work between acquisitions */
+#define DEFAULT_LOCKS                   "mutex,spin,tas,ttas,ticket,mcs,clh,cohort,futex"
+#define MAX_CS_LINES                    64
+#define UNCONTENDED_OPS                 (1 << 20)
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+extern const lock_bench_family_t lock_bench_mutex;
+extern const lock_bench_family_t lock_bench_spin;
+extern const lock_bench_family_t lock_bench_tas;
+extern const lock_bench_family_t lock_bench_ttas;
+extern const lock_bench_family_t lock_bench_ticket;
+extern const lock_bench_family_t lock_bench_mcs;
+extern const lock_bench_family_t lock_bench_clh;
+extern const lock_bench_family_t lock_bench_cohort;
+extern const lock_bench_family_t lock_bench_futex;
+
+static const lock_bench_family_t* families[] =
+  {
+    &lock_bench_mutex,
+    &lock_bench_spin,
+    &lock_bench_tas,
+    &lock_bench_ttas,
+    &lock_bench_ticket,
+    &lock_bench_mcs,
+    &lock_bench_clh,
+    &lock_bench_cohort,
+    &lock_bench_futex,
+  };
+
+#define NB_FAMILIES (sizeof(families) / sizeof(families[0]))
+
+/* written by the lock holder only */
+typedef struct shared
+{
+  volatile uint64_t count;
+  volatile int64_t last_owner;
+  volatile uint64_t last_node;
+  volatile uint64_t last_release;
+  uint8_t padding[64 - 4 * sizeof(uint64_t)];
+  volatile uint64_t lines[MAX_CS_LINES][8];
+} __attribute__ ((aligned(64))) shared_t;
+
+static shared_t shared;
+
+typedef struct thread_data
+{
+  int64_t id;
+  uint64_t node;
+  uint64_t nb_acquired;
+  uint64_t nb_handoffs;
+  uint64_t nb_local;		/* handoffs from a thread of the same node */
+  uint64_t handoff_sum;
+  uint64_t handoff_max;
+  uint8_t padding[64];
+} thread_data_t;
+
+static const lock_bench_family_t* family;
+static int cs_lines = DEFAULT_CS_LINES;
+static uint64_t outside = DEFAULT_OUTSIDE;
+static int use_trylock = 0;
+static volatile int work = 1;
+static volatile int started = 0;
+
+static uint64_t
+numa_node()
+{
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    {
+      node = 0;
+    }
+  return node;
+}
+
+static inline void
+spin(uint64_t cycles)
+{
+  uint64_t start = getticks();
+  while (getticks() - start < cycles)
+    {
+      asm volatile ("pause");
+    }
+}
+
+static inline void
+acquire()
+{
+  if (use_trylock)
+    {
+      while (!family->trylock())
+	{
+	  asm volatile ("pause");
+	}
+    }
+  else
+    {
+      family->lock();
+    }
+}
+
+void*
+test(void* data)
+{
+  thread_data_t* d = (thread_data_t*) data;
+  d->node = numa_node();
+  __sync_fetch_and_add(&started, 1);
+
+  while (work)
+    {
+      acquire();
+      uint64_t now = getticks();
+      if (shared.last_owner >= 0 && shared.last_owner != d->id)
+	{
+	  uint64_t h = now > shared.last_release ? now - shared.last_release : 0;
+	  d->nb_handoffs++;
+	  d->handoff_sum += h;
+	  if (h > d->handoff_max)
+	    {
+	      d->handoff_max = h;
+	    }
+	  d->nb_local += (shared.last_node == d->node);
+	}
+
+      shared.count++;
+      int l;
+      for (l = 0; l < cs_lines; l++)
+	{
+	  shared.lines[l][0]++;
+	}
+      shared.last_owner = d->id;
+      shared.last_node = d->node;
+      shared.last_release = getticks();
+      family->unlock();
+
+      d->nb_acquired++;
+      spin(outside);
+    }
+
+  return NULL;
+}
+
+/* cycles of an uncontended lock/unlock pair */
+static double
+uncontended()
+{
+  uint64_t start = getticks();
+  int i;
+  for (i = 0; i < UNCONTENDED_OPS; i++)
+    {
+      acquire();
+      family->unlock();
+    }
+  return (getticks() - start) / (double) UNCONTENDED_OPS;
+}
+
+static void
+run(int num_threads, int duration)
+{
+  thread_data_t* data = (thread_data_t*) memalign(64, num_threads * sizeof(thread_data_t));
+  pthread_t threads[num_threads];
+  assert(data != NULL);
+
+  family->init();
+  double solo = uncontended();
+
+  memset(&shared, 0, sizeof(shared));
+  shared.last_owner = -1;
+  work = 1;
+  started = 0;
+  long t;
+  for (t = 0; t < num_threads; t++)
+    {
+      memset(&data[t], 0, sizeof(thread_data_t));
+      data[t].id = t;
+      if (pthread_create(&threads[t], NULL, test, &data[t]))
+	{
+	  printf("ERROR; pthread_create()\n");
+	  exit(-1);
+	}
+    }
+  while (started < num_threads)
+    {
+      asm volatile ("pause");
+    }
+
+  sleep(duration);
+  asm volatile ("mfence");
+  work = 0;
+  asm volatile ("mfence");
+
+  uint64_t acquired = 0, handoffs = 0, local = 0, sum = 0, max = 0, min_acq = UINT64_MAX, max_acq = 0;
+  double sq = 0;
+  for (t = 0; t < num_threads; t++)
+    {
+      pthread_join(threads[t], NULL);
+      acquired += data[t].nb_acquired;
+      handoffs += data[t].nb_handoffs;
+      local += data[t].nb_local;
+      sum += data[t].handoff_sum;
+      max = data[t].handoff_max > max ? data[t].handoff_max : max;
+      min_acq = data[t].nb_acquired < min_acq ? data[t].nb_acquired : min_acq;
+      max_acq = data[t].nb_acquired > max_acq ? data[t].nb_acquired : max_acq;
+      sq += (double) data[t].nb_acquired * data[t].nb_acquired;
+    }
+  family->destroy();
+
+  if (shared.count != acquired)
+    {
+      printf("%s: mutual exclusion violated (%zu increments for %zu acquisitions)\n",
+	     family->name, (size_t) shared.count, (size_t) acquired);
+      exit(1);
+    }
+
+  printf("%-7s %-8d %-12.0f %-10.1f %-12.0f %-12zu %-8.1f %-8.3f %-8.2f\n",
+	 family->name, num_threads, acquired / (double) duration, solo,
+	 handoffs ? sum / (double) handoffs : 0.0, (size_t) max,
+	 handoffs ? 100.0 * local / handoffs : 0.0,
+	 sq > 0 ? (double) acquired * acquired / (num_threads * sq) : 0.0,
+	 max_acq ? min_acq / (double) max_acq : 0.0);
+  free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help", no_argument, NULL, 'h'},
+      {"num-threads", required_argument, NULL, 'n'},
+      {"duration", required_argument, NULL, 'd'},
+      {"locks", required_argument, NULL, 'l'},
+      {"cs-lines", required_argument, NULL, 'c'},
+      {"outside", required_argument, NULL, 'o'},
+      {"trylock", no_argument, NULL, 't'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int duration = DEFAULT_DURATION;
+  int num_threads = DEFAULT_NB_THREADS;
+  char* locks = strdup(DEFAULT_LOCKS);
+
+  int i, c;
+  while (1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hn:d:l:c:o:t", long_options, &i);
+
+      if (c == -1)
+	break;
+
+      if (c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch (c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'h':
+	  printf("lock_bench -- handoff latency and fairness per lock family\n"
+		 "\n"
+		 "Usage:\n"
+		 "  lock_bench [options...]\n"
+		 "\n"
+		 "Options:\n"
+		 "  -h, --help\n"
+		 "        Print this message\n"
+		 "  -n, --num-threads <int>\n"
+		 "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+		 "  -d, --duration <int>\n"
+		 "        Duration of each run in seconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+		 "  -l, --locks <list>\n"
+		 "        Comma-separated lock families (default=" DEFAULT_LOCKS ")\n"
+		 "  -c, --cs-lines <int>\n"
+		 "        Cache lines written in the critical section (default=" XSTR(DEFAULT_CS_LINES) ", max=" XSTR(MAX_CS_LINES) ")\n"
+		 "  -o, --outside <int>\n"
+		 "        Cycles of work between two acquisitions (default=" XSTR(DEFAULT_OUTSIDE) ")\n"
+		 "  -t, --trylock\n"
+		 "        Acquire by spinning on TRYLOCK() instead of LOCK()\n"
+		 );
+	  exit(0);
+	case 'n':
+	  num_threads = atoi(optarg);
+	  break;
+	case 'd':
+	  duration = atoi(optarg);
+	  break;
+	case 'l':
+	  free(locks);
+	  locks = strdup(optarg);
+	  break;
+	case 'c':
+	  cs_lines = atoi(optarg);
+	  break;
+	case 'o':
+	  outside = atol(optarg);
+	  break;
+	case 't':
+	  use_trylock = 1;
+	  break;
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  assert(duration > 0);
+  assert(num_threads > 0);
+  assert(cs_lines >= 0 && cs_lines <= MAX_CS_LINES);
+
+  printf("# handoff latency in cycles (TSC), local: %% of handoffs within a NUMA node\n");
+  printf("#%-6s %-8s %-12s %-10s %-12s %-12s %-8s %-8s %-8s\n", "Lock", "Threads", "Acquires/s",
+	 "Solo", "Handoff", "Handoff-max", "Local%", "Jain", "Min/max");
+
+  char* save;
+  char* name;
+  for (name = strtok_r(locks, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save))
+    {
+      family = NULL;
+      size_t f;
+      for (f = 0; f < NB_FAMILIES; f++)
+	{
+	  if (strcmp(families[f]->name, name) == 0)
+	    {
+	      family = families[f];
+	    }
+	}
+      if (family == NULL)
+	{
+	  printf("unknown lock family: %s\n", name);
+	  exit(1);
+	}
+      run(num_threads, duration);
+    }
+
+  free(locks);
+  return 0;
+}
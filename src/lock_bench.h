@@ -0,0 +1,15 @@
+#ifndef _LOCK_BENCH_H_
+#define _LOCK_BENCH_H_
+
+/* a lock family of lock_if.h, as compiled in lock_bench_family.c */
+typedef struct lock_bench_family
+{
+  const char* name;
+  void (*init)();
+  void (*destroy)();
+  void (*lock)();
+  int (*trylock)();		/* nonzero if acquired */
+  void (*unlock)();
+} lock_bench_family_t;
+
+#endif	/* _LOCK_BENCH_H_ */
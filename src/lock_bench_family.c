@@ -0,0 +1,58 @@
+#include <pthread.h>
+
+#include "lock_if.h"
+#include "lock_bench.h"
+
+/*
+ * One lock family of lock_if.h for lock_bench: compiled once per family,
+ * with -D<FAMILY> -DLOCK_BENCH_FAMILY=<name>, into lock_bench_<name>.
+ */
+
+#define LOCK_BENCH_SYM2(name)           lock_bench_##name
+#define LOCK_BENCH_SYM(name)            LOCK_BENCH_SYM2(name)
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+LOCK_LOCAL_DATA;
+
+static ptlock_t lock_bench_lock __attribute__ ((aligned(64)));
+
+static void
+lock_bench_init()
+{
+  INIT_LOCK(&lock_bench_lock);
+}
+
+static void
+lock_bench_destroy()
+{
+  DESTROY_LOCK(&lock_bench_lock);
+}
+
+static void
+lock_bench_lock_lock()
+{
+  LOCK(&lock_bench_lock);
+}
+
+static int
+lock_bench_trylock()
+{
+  return TRYLOCK(&lock_bench_lock);
+}
+
+static void
+lock_bench_unlock()
+{
+  UNLOCK(&lock_bench_lock);
+}
+
+const lock_bench_family_t LOCK_BENCH_SYM(LOCK_BENCH_FAMILY) =
+  {
+    .name = XSTR(LOCK_BENCH_FAMILY),
+    .init = lock_bench_init,
+    .destroy = lock_bench_destroy,
+    .lock = lock_bench_lock_lock,
+    .trylock = lock_bench_trylock,
+    .unlock = lock_bench_unlock,
+  };
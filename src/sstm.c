@@ -1,16 +1,316 @@
+#include <string.h>
+#include <unistd.h>
+#include <cpuid.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
 #include "sstm.h"
+#include "sstm_clock.h"
+#include "sstm_cm.h"
+#include "sstm_validate.h"
 
 LOCK_LOCAL_DATA;
-__thread sstm_metadata_t sstm_meta;	 /* per-thread metadata */
+__thread sstm_metadata_t sstm_meta = { .numa_node = -1 }; /* per-thread metadata */
 sstm_metadata_global_t sstm_meta_global; /* global metadata */
 
+sstm_thread_slot_t sstm_thread_slots[SSTM_MAX_THREADS] __attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+/* indexed by sstm_algo_id_t */
+static const sstm_algo_t* sstm_algos[SSTM_ALGO_NUM] =
+  {
+    &sstm_algo_gl,
+    &sstm_algo_tl2,
+    &sstm_algo_norec,
+    &sstm_algo_tiny,
+    &sstm_algo_mvcc,
+  };
+
+static sstm_algo_id_t sstm_algo_selected = SSTM_ALGO_DEFAULT;
+
+static int
+sstm_algo_lookup(const char* name)
+{
+  int i;
+  for (i = 0; i < SSTM_ALGO_NUM; i++)
+    {
+      if (strcmp(sstm_algos[i]->name, name) == 0)
+	{
+	  return i;
+	}
+    }
+  return -1;
+}
+
+/* selects the algorithm to be used by the next sstm_start()
+*/
+int
+sstm_set_algo(const char* name)
+{
+  int id = sstm_algo_lookup(name);
+  if (id < 0)
+    {
+      return -1;
+    }
+  sstm_algo_selected = id;
+  return 0;
+}
+
+const char*
+sstm_algo_name()
+{
+  return sstm_algos[sstm_meta_global.algo_id]->name;
+}
+
+const char* sstm_clock_names[SSTM_CLOCK_NUM] = { "gv1", "gv4", "gv5", "gv6", "tsc" };
+
+static sstm_clock_id_t sstm_clock_selected = SSTM_CLOCK_DEFAULT;
+
+static int
+sstm_clock_lookup(const char* name)
+{
+  int i;
+  for (i = 0; i < SSTM_CLOCK_NUM; i++)
+    {
+      if (strcmp(sstm_clock_names[i], name) == 0)
+	{
+	  return i;
+	}
+    }
+  return -1;
+}
+
+/* the tsc clock orders commits only if the TSCs of all cores tick at a
+   constant rate and in sync: the invariant TSC, CPUID.80000007H:EDX[8] */
+static int
+sstm_clock_supported(int id)
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (id != SSTM_CLOCK_TSC)
+    {
+      return 1;
+    }
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8));
+}
+
+/* selects the clock scheme to be used by the next sstm_start()
+*/
+int
+sstm_set_clock(const char* name)
+{
+  int id = sstm_clock_lookup(name);
+  if (id < 0 || !sstm_clock_supported(id))
+    {
+      return -1;
+    }
+  sstm_clock_selected = id;
+  return 0;
+}
+
+const char*
+sstm_clock_name()
+{
+  return sstm_clock_names[sstm_meta_global.clock_id];
+}
+
+static sstm_cm_id_t sstm_cm_selected = SSTM_CM_DEFAULT;
+
+static int
+sstm_cm_lookup(const char* name)
+{
+  int i;
+  for (i = 0; i < SSTM_CM_NUM; i++)
+    {
+      if (strcmp(sstm_cms[i]->name, name) == 0)
+	{
+	  return i;
+	}
+    }
+  return -1;
+}
+
+/* selects the contention manager to be used by the next sstm_start()
+*/
+int
+sstm_set_cm(const char* name)
+{
+  int id = sstm_cm_lookup(name);
+  if (id < 0)
+    {
+      return -1;
+    }
+  sstm_cm_selected = id;
+  return 0;
+}
+
+const char*
+sstm_cm_name()
+{
+  return sstm_meta_global.cm->name;
+}
+
+static int sstm_validate_selected = -1; /* -1: the best the CPU supports */
+
+static int
+sstm_validate_lookup(const char* name)
+{
+  int i;
+  for (i = 0; i < SSTM_VALIDATE_NUM; i++)
+    {
+      if (strcmp(sstm_validates[i]->name, name) == 0 && sstm_validates[i]->supported())
+	{
+	  return i;
+	}
+    }
+  return -1;
+}
+
+/* selects the validation kernels to be used by the next sstm_start()
+*/
+int
+sstm_set_validate(const char* name)
+{
+  int id = sstm_validate_lookup(name);
+  if (id < 0)
+    {
+      return -1;
+    }
+  sstm_validate_selected = id;
+  return 0;
+}
+
+const char*
+sstm_validate_name()
+{
+  return sstm_meta_global.validate->name;
+}
+
+static const char* sstm_nesting_names[2] = { "flat", "closed" };
+static int sstm_nesting_selected = 0;
+
+/* selects flat or closed nesting for the next sstm_start()
+*/
+int
+sstm_set_nesting(const char* name)
+{
+  int i;
+  for (i = 0; i < 2; i++)
+    {
+      if (strcmp(sstm_nesting_names[i], name) == 0)
+	{
+	  sstm_nesting_selected = i;
+	  return 0;
+	}
+    }
+  return -1;
+}
+
+const char*
+sstm_nesting_name()
+{
+  return sstm_nesting_names[sstm_meta_global.nesting_closed];
+}
+
+static size_t
+sstm_env_size(const char* name, size_t def)
+{
+  const char* env = getenv(name);
+  return (env != NULL && *env != '\0') ? strtoul(env, NULL, 0) : def;
+}
+
 /* initializes the TM runtime 
    (e.g., allocates the locks that the system uses ) 
 */
 void
 sstm_start()
 {
+  const char* env = getenv(SSTM_ALGO_ENV);
+  if (env != NULL && sstm_set_algo(env) != 0)
+    {
+      fprintf(stderr, "sstm: unknown algorithm %s=%s (available:", SSTM_ALGO_ENV, env);
+      int i;
+      for (i = 0; i < SSTM_ALGO_NUM; i++)
+	{
+	  fprintf(stderr, " %s", sstm_algos[i]->name);
+	}
+      fprintf(stderr, ")\n");
+      exit(1);
+    }
+
+  env = getenv(SSTM_CLOCK_ENV);
+  if (env != NULL && sstm_set_clock(env) != 0)
+    {
+      fprintf(stderr, "sstm: unknown or unsupported clock %s=%s (available:", SSTM_CLOCK_ENV, env);
+      int i;
+      for (i = 0; i < SSTM_CLOCK_NUM; i++)
+	{
+	  if (sstm_clock_supported(i))
+	    {
+	      fprintf(stderr, " %s", sstm_clock_names[i]);
+	    }
+	}
+      fprintf(stderr, ")\n");
+      exit(1);
+    }
+
+  env = getenv(SSTM_CM_ENV);
+  if (env != NULL && sstm_set_cm(env) != 0)
+    {
+      fprintf(stderr, "sstm: unknown contention manager %s=%s (available:", SSTM_CM_ENV, env);
+      int i;
+      for (i = 0; i < SSTM_CM_NUM; i++)
+	{
+	  fprintf(stderr, " %s", sstm_cms[i]->name);
+	}
+      fprintf(stderr, ")\n");
+      exit(1);
+    }
+
+  env = getenv(SSTM_VALIDATE_ENV);
+  if (env != NULL && sstm_set_validate(env) != 0)
+    {
+      fprintf(stderr, "sstm: unknown or unsupported validation %s=%s (available:", SSTM_VALIDATE_ENV, env);
+      int i;
+      for (i = 0; i < SSTM_VALIDATE_NUM; i++)
+	{
+	  if (sstm_validates[i]->supported())
+	    {
+	      fprintf(stderr, " %s", sstm_validates[i]->name);
+	    }
+	}
+      fprintf(stderr, ")\n");
+      exit(1);
+    }
+
+  env = getenv(SSTM_NESTING_ENV);
+  if (env != NULL && sstm_set_nesting(env) != 0)
+    {
+      fprintf(stderr, "sstm: unknown nesting %s=%s (available: flat closed)\n", SSTM_NESTING_ENV, env);
+      exit(1);
+    }
+
+  sstm_meta_global.algo_id = sstm_algo_selected;
+  sstm_meta_global.algo = sstm_algos[sstm_algo_selected];
+
   INIT_LOCK(&sstm_meta_global.glock);
+  sstm_meta_global.n_threads = 0;
+  sstm_stats_reset();
+  sstm_meta_global.serial = 0;
+  sstm_meta_global.epoch = 1;
+  sstm_meta_global.serial_after = sstm_env_size(SSTM_SERIAL_AFTER_ENV, SSTM_SERIAL_AFTER_DEFAULT);
+  sstm_meta_global.park_after = sstm_env_size(SSTM_PARK_AFTER_ENV, SSTM_PARK_AFTER_DEFAULT);
+  /* with membarrier(), TX starts only need a compiler barrier */
+  sstm_meta_global.serial_membarrier =
+    (syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0);
+  sstm_meta_global.clock = 0;
+  sstm_meta_global.clock_id = sstm_clock_selected;
+  sstm_meta_global.clock_base = getticks();
+  sstm_meta_global.cm_id = sstm_cm_selected;
+  sstm_meta_global.cm = sstm_cms[sstm_cm_selected];
+  sstm_meta_global.validate_id = sstm_validate_selected >= 0 ? sstm_validate_selected : sstm_validate_default();
+  sstm_meta_global.validate = sstm_validates[sstm_meta_global.validate_id];
+  sstm_meta_global.nesting_closed = sstm_nesting_selected;
+  sstm_meta_global.algo->start();
 }
 
 /* terminates the TM runtime
@@ -19,6 +319,13 @@ sstm_start()
 void
 sstm_stop()
 {
+  sstm_meta_global.algo->stop();
+
+  const char* env = getenv(SSTM_PROFILE_ENV);
+  if (env != NULL && *env != '\0' && strcmp(env, "0") != 0)
+    {
+      sstm_print_site_stats();
+    }
 }
 
 
@@ -28,6 +335,31 @@ sstm_stop()
 void
 sstm_thread_start()
 {
+  sstm_meta.id = __sync_fetch_and_add(&sstm_meta_global.n_threads, 1);
+  assert(sstm_meta.id < SSTM_MAX_THREADS);
+  /* a pinned thread moves its metadata (thread-local, so first touched
+     by the thread that created it) to its node */
+  sstm_meta.numa_node = sstm_numa_thread_node();
+  sstm_numa_bind(&sstm_meta, sizeof(sstm_meta), sstm_meta.numa_node);
+  sstm_thread_slots[sstm_meta.id].active = 0;
+  sstm_meta.algo_id = sstm_meta_global.algo_id;
+  sstm_meta.serial_next = 0;
+  sstm_meta.irrevocable = 0;
+  memset(&sstm_meta.stats, 0, sizeof(sstm_stats_t));
+  memset(&sstm_meta.latency, 0, sizeof(sstm_latency_t));
+  sstm_meta.site_stats = NULL;
+  sstm_meta.site_stats_size = 0;
+  sstm_meta.n_retries = 0;
+  sstm_meta.cm_karma = 0;
+  sstm_meta.cm_enemy = NULL;
+  sstm_meta.nesting = 0;
+  sstm_meta.nest_n = 0;
+  sstm_undo_log_init(&sstm_meta.nest_log);
+  sstm_meta.cm_seeds[0] = getticks() ^ (sstm_meta.id * 0x9E3779B97F4A7C15UL);
+  sstm_meta.cm_seeds[1] = sstm_meta.cm_seeds[0] * 362436069 + 1;
+  sstm_meta.cm_seeds[2] = sstm_meta.cm_seeds[1] * 521288629 + 1;
+  sstm_alloc_thread_start();
+  sstm_meta_global.algo->thread_start();
 }
 
 /* terminates thread local data
@@ -40,51 +372,377 @@ sstm_thread_stop()
 {
   __sync_fetch_and_add(&sstm_meta_global.n_commits, sstm_meta.n_commits);
   __sync_fetch_and_add(&sstm_meta_global.n_aborts, sstm_meta.n_aborts);
+  sstm_stats_merge(&sstm_meta.stats);
+  sstm_site_stats_merge();
+  sstm_epoch_thread_stop();
+  sstm_alloc_thread_stop();
+  sstm_pool_release();
+  sstm_latency_merge(&sstm_meta.latency);
+  sstm_undo_log_destroy(&sstm_meta.nest_log);
+  sstm_meta_global.algo->thread_stop();
 }
 
+/* the serial TX may sleep while it waits for our slot to be 0. We may
+   miss it if it sets serial after we read it, so it also sleeps with a
+   timeout
+*/
+static inline void
+sstm_serial_wake_drain()
+{
+  if (__builtin_expect(sstm_meta_global.serial != 0, 0))
+    {
+      futex_wake((volatile uint32_t*) &sstm_thread_slots[sstm_meta.id].active, 1);
+    }
+}
 
-/* transactionally reads the value of addr
- * On a more complex than GL-STM algorithm,
- * you need to do more work than simply reading the value.
+/* announces an optimistic TX and the reclamation epoch it started in,
+   waiting while a serial TX runs. only writes the thread's own slot
 */
-inline uintptr_t
-sstm_tx_load(volatile uintptr_t* addr)
+static inline void
+sstm_serial_announce()
 {
-  return *addr;
+  volatile size_t* active = &sstm_thread_slots[sstm_meta.id].active;
+  while (1)
+    {
+      *active = sstm_meta_global.epoch;
+      if (sstm_meta_global.serial_membarrier)
+	{
+	  COMPILER_BARRIER();
+	}
+      else
+	{
+	  __sync_synchronize();
+	}
+
+      if (__builtin_expect(!sstm_meta_global.serial, 1))
+	{
+	  return;
+	}
+
+      *active = 0;
+      sstm_serial_wake_drain();
+      futex_wait_zero(&sstm_meta_global.serial, sstm_meta_global.park_after);
+    }
 }
 
-/* transactionally writes val in addr
- * On a more complex than GL-STM algorithm,
- * you need to do more work than simply reading the value.
+static inline void
+sstm_serial_retire()
+{
+  sstm_thread_slots[sstm_meta.id].active = 0;
+  sstm_serial_wake_drain();
+}
+
+void
+sstm_slots_fence()
+{
+  if (sstm_meta_global.serial_membarrier)
+    {
+      syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+    }
+  else
+    {
+      __sync_synchronize();
+    }
+}
+
+/* takes the global lock, stops new optimistic TXs and waits for the
+   ones in flight to finish: from then on, the TX runs alone and
+   accesses memory directly, so it cannot abort
 */
-inline void
-sstm_tx_store(volatile uintptr_t* addr, uintptr_t val)
+static void
+sstm_serial_enter()
 {
-  *addr = val;
+  LOCK(&sstm_meta_global.glock);
+  sstm_meta_global.serial = FUTEX_HELD;
+  sstm_slots_fence();
+
+  const struct timespec slice = { 0, SSTM_PARK_SLICE_US * 1000 };
+  uint64_t park_after = sstm_meta_global.park_after;
+  size_t i, n = sstm_meta_global.n_threads;
+  for (i = 0; i < n; i++)
+    {
+      uint64_t start = getticks();
+      size_t a;
+      while ((a = sstm_thread_slots[i].active) != 0)
+	{
+	  if (park_after != 0 && getticks() - start > park_after)
+	    {
+	      /* the low half of the slot (x86 is little-endian) */
+	      futex_wait((volatile uint32_t*) &sstm_thread_slots[i].active, (uint32_t) a, &slice);
+	    }
+	  else
+	    {
+	      PAUSE();
+	    }
+	}
+    }
+
+  sstm_meta.irrevocable = 1;
+  sstm_meta.algo_id = SSTM_ALGO_GL;
+  sstm_meta.ro = 0;
+}
+
+static void
+sstm_serial_exit()
+{
+  sstm_meta.irrevocable = 0;
+  sstm_meta.serial_next = 0;
+  sstm_meta.algo_id = sstm_meta_global.algo_id;
+  futex_clear(&sstm_meta_global.serial);
+  UNLOCK(&sstm_meta_global.glock);
+}
+
+/* starts (or restarts) a transaction: sites that have only committed
+   without stores (or were hinted with TX_START_RO()) run in read-only
+   mode; TXs that aborted too often run in serial mode
+*/
+void
+sstm_tx_start(sstm_site_t* site)
+{
+  sstm_meta.site = site;
+  sstm_meta.wrote = 0;
+  sstm_meta.nesting = 1;
+  if (sstm_meta.nest_n > 0)
+    {
+      sstm_meta.nest_n = 0;	/* restarted from a closed nested TX */
+      sstm_log_clear(&sstm_meta.nest_log);
+    }
+  if (sstm_meta.n_retries == 0)
+    {
+      sstm_meta.tx_begin = getticks();
+      sstm_meta.site_stats_cur = sstm_site_stats_get(site);
+    }
+  if (sstm_meta_global.algo->serial)
+    {
+      if (__builtin_expect(sstm_meta.serial_next, 0))
+	{
+	  sstm_serial_enter();
+	  return;
+	}
+      sstm_serial_announce();
+    }
+  sstm_meta.ro = (site->state == SSTM_SITE_RO && !sstm_meta.ro_disable && sstm_meta_global.algo->read_only);
+  if (sstm_meta.n_retries == 0)
+    {
+      sstm_meta_global.cm->tx_start();
+    }
+  sstm_meta_global.algo->tx_start();
+}
+
+void
+sstm_tx_upgrade()
+{
+  sstm_meta.site->state = SSTM_SITE_RW;
+  sstm_tx_abort(SSTM_ABORT_RO_UPGRADE);
+}
+
+void
+sstm_tx_irrevocable()
+{
+  if (!sstm_meta.irrevocable && sstm_meta_global.algo->serial)
+    {
+      sstm_meta.serial_next = 1;
+      sstm_tx_abort(SSTM_ABORT_SERIAL);
+    }
 }
 
 /* cleaning up in case of an abort 
-   (e.g., flush the read or write logs)
+   (e.g., flush the read or write logs), then lets the contention
+   manager delay the retry of TXs that aborted on a conflict
 */
 void
-sstm_tx_cleanup()
+sstm_tx_cleanup(int reason)
 {
-  sstm_alloc_on_abort();
-  sstm_meta.n_aborts++;
+  if (sstm_meta.irrevocable)
+    {
+      fprintf(stderr, "sstm: TX_ABORT() in a serial-mode (irrevocable) transaction\n");
+      abort();
+    }
+
+  size_t work = sstm_meta.read_set.n + sstm_meta.write_set.log.n + sstm_meta.undo_log.n;
+  sstm_meta_global.algo->tx_cleanup();
+  sstm_cm_wake();
+  if (sstm_meta_global.algo->serial)
+    {
+      sstm_serial_retire();
+    }
+  sstm_meta.n_retries++;
+  sstm_meta.stats.n_aborts++;
+  sstm_meta.site_stats_cur->n_aborts++;
+  assert(reason > 0 && reason < SSTM_ABORT_NUM);
+  sstm_meta.stats.aborts[reason]++;
+
+  if (reason == SSTM_ABORT_CAPACITY)
+    {
+      sstm_meta.serial_next = 1;
+    }
+  else if (reason != SSTM_ABORT_EXPLICIT && reason != SSTM_ABORT_RO_UPGRADE && reason != SSTM_ABORT_SERIAL)
+    {
+      if (sstm_meta_global.serial_after && sstm_meta.n_retries >= sstm_meta_global.serial_after)
+	{
+	  sstm_meta.serial_next = 1;
+	}
+      else
+	{
+	  sstm_meta_global.cm->tx_abort(work);
+	}
+    }
+  sstm_meta.cm_enemy = NULL;
 }
 
 /* tries to commit a transaction
-   (e.g., validates some version number, and/or
-   acquires a couple of locks)
- */
+*/
 void
 sstm_tx_commit()
 {
-  UNLOCK(&sstm_meta_global.glock);	       
-  sstm_alloc_on_commit();
-  sstm_meta.n_commits++;		
+  if (sstm_meta.nesting > 1)
+    {
+      sstm_nest_commit();
+      return;
+    }
+  sstm_meta.nesting = 0;
+
+  sstm_stats_t* stats = &sstm_meta.stats;
+  sstm_site_stats_t* site = sstm_meta.site_stats_cur;
+  if (__builtin_expect(sstm_meta.irrevocable, 0))
+    {
+      sstm_alloc_on_commit();
+      sstm_meta.n_commits++;
+      sstm_serial_exit();
+      stats->n_commits_serial++;
+    }
+  else
+    {
+      size_t rset = sstm_meta.read_set.n;
+      size_t wset = sstm_meta.write_set.log.n + sstm_meta.undo_log.n;
+      sstm_meta_global.algo->tx_commit();
+      sstm_cm_wake();
+      if (sstm_meta_global.algo->serial)
+	{
+	  sstm_serial_retire();
+	}
+
+      if (sstm_meta.ro)
+	{
+	  stats->n_commits_ro++;
+	}
+      else
+	{
+	  stats->rset += rset;
+	  stats->rset_hist[sstm_stats_bucket(rset)]++;
+	  stats->wset += wset;
+	  stats->wset_hist[sstm_stats_bucket(wset)]++;
+	}
+      site->rset += rset;
+      site->wset += wset;
+    }
+
+  uint64_t cycles = getticks() - sstm_meta.tx_begin;
+  sstm_latency_add(&sstm_meta.latency, cycles);
+  site->n_commits++;
+  site->cycles += cycles;
+  stats->n_commits++;
+  stats->retries += sstm_meta.n_retries;
+  stats->retries_hist[sstm_stats_bucket(sstm_meta.n_retries)]++;
+
+  if (sstm_meta.site->state == SSTM_SITE_UNKNOWN)
+    {
+      sstm_meta.site->state = sstm_meta.wrote ? SSTM_SITE_RW : SSTM_SITE_RO;
+    }
+  sstm_meta.ro_disable = 0;
+  sstm_meta.n_retries = 0;
+  sstm_meta_global.cm->tx_commit();
 }
 
+/* the unaligned head and tail of a range are accessed as sub-words,
+   the aligned part as whole words
+*/
+void
+sstm_tx_load_range(void* dst, volatile void* src, size_t size)
+{
+  const size_t W = sizeof(uintptr_t);
+  char* d = (char*) dst;
+  uintptr_t s = (uintptr_t) src;
+  uintptr_t v;
+
+  size_t head = (W - (s & (W - 1))) & (W - 1);
+  if (head > size)
+    {
+      head = size;
+    }
+  if (head > 0)
+    {
+      v = sstm_tx_load_bytes((volatile void*) s, head);
+      memcpy(d, &v, head);
+      d += head;
+      s += head;
+      size -= head;
+    }
+
+  size_t n = size / W;
+  if (((uintptr_t) d & (W - 1)) == 0)
+    {
+      sstm_tx_load_words((uintptr_t*) d, (volatile uintptr_t*) s, n);
+    }
+  else
+    {
+      /* misaligned destination: go through an aligned buffer */
+      uintptr_t buf[SSTM_RANGE_BUF_WORDS];
+      size_t done = 0;
+      while (done < n)
+	{
+	  size_t k = n - done < SSTM_RANGE_BUF_WORDS ? n - done : SSTM_RANGE_BUF_WORDS;
+	  sstm_tx_load_words(buf, (volatile uintptr_t*) s + done, k);
+	  memcpy(d + done * W, buf, k * W);
+	  done += k;
+	}
+    }
+  d += n * W;
+  s += n * W;
+  size -= n * W;
+
+  if (size > 0)
+    {
+      v = sstm_tx_load_bytes((volatile void*) s, size);
+      memcpy(d, &v, size);
+    }
+}
+
+void
+sstm_tx_store_range(volatile void* dst, const void* src, size_t size)
+{
+  const size_t W = sizeof(uintptr_t);
+  uintptr_t d = (uintptr_t) dst;
+  const char* s = (const char*) src;
+  uintptr_t v = 0;
+
+  size_t head = (W - (d & (W - 1))) & (W - 1);
+  if (head > size)
+    {
+      head = size;
+    }
+  if (head > 0)
+    {
+      memcpy(&v, s, head);
+      sstm_tx_store_bytes((volatile void*) d, v, head);
+      d += head;
+      s += head;
+      size -= head;
+    }
+
+  for (; size >= W; size -= W, d += W, s += W)
+    {
+      memcpy(&v, s, W);
+      sstm_tx_store((volatile uintptr_t*) d, v);
+    }
+
+  if (size > 0)
+    {
+      v = 0;
+      memcpy(&v, s, size);
+      sstm_tx_store_bytes((volatile void*) d, v, size);
+    }
+}
 
 /* prints the TM system stats
 ****** DO NOT TOUCH *********
@@ -99,3 +757,55 @@ sstm_print_stats(double dur_s)
 	 sstm_meta_global.n_aborts,
 	 sstm_meta_global.n_aborts / dur_s);
 }
+
+/* maps the (zeroed) orec table, configured from the environment:
+   SSTM_OREC_BITS   : log2 of the number of orecs
+   SSTM_OREC_STRIPE : bytes covered by an orec: "word", "line", or a log2 shift
+   SSTM_OREC_PAD    : 1 to give every orec its own cache line
+*/
+void
+sstm_orecs_create()
+{
+  sstm_orec_table_t* t = &sstm_meta_global.orecs;
+  size_t bits = sstm_env_size(SSTM_OREC_BITS_ENV, SSTM_OREC_BITS_DEFAULT);
+  assert(bits > 0 && bits < 40);
+
+  t->shift = SSTM_OREC_SHIFT_DEFAULT;
+  const char* stripe = getenv(SSTM_OREC_STRIPE_ENV);
+  if (stripe != NULL && strcmp(stripe, "word") == 0)
+    {
+      t->shift = 3;
+    }
+  else if (stripe != NULL && strcmp(stripe, "line") == 0)
+    {
+      t->shift = __builtin_ctz(CACHE_LINE_SIZE);
+    }
+  else if (stripe != NULL && *stripe != '\0')
+    {
+      t->shift = strtoul(stripe, NULL, 0);
+    }
+  assert(t->shift < 64);
+
+  t->stride = sstm_env_size(SSTM_OREC_PAD_ENV, SSTM_OREC_PAD_DEFAULT) ?
+    __builtin_ctz(CACHE_LINE_SIZE / sizeof(sstm_orec_t)) : 0;
+  t->mask = (1UL << bits) - 1;
+  t->bytes = (1UL << bits) * (sizeof(sstm_orec_t) << t->stride);
+
+  void* mem = mmap(NULL, t->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    {
+      perror("sstm: mmap orec table");
+      exit(1);
+    }
+#if defined(MADV_HUGEPAGE)
+  madvise(mem, t->bytes, MADV_HUGEPAGE);
+#endif
+  t->orecs = (sstm_orec_t*) mem;
+}
+
+void
+sstm_orecs_destroy()
+{
+  munmap((void*) sstm_meta_global.orecs.orecs, sstm_meta_global.orecs.bytes);
+  sstm_meta_global.orecs.orecs = NULL;
+}
@@ -1,20 +1,423 @@
-#include "sstm_alloc.h"
+#include <string.h>
+#include <sys/mman.h>
 
-__thread sstm_alloc_t sstm_allocator = { .n_allocs = 0 };
-__thread sstm_alloc_t sstm_freeing = { .n_allocs = 0 };
+#include "sstm.h"
+
+static __thread sstm_log_t sstm_allocator; /* of void*, see sstm_log.h */
+static __thread sstm_log_t sstm_freeing;
+
+/* **************************************************************************************************** */
+/* per-thread size-class pools */
+/* **************************************************************************************************** */
+
+/* Objects live in SSTM_POOL_SLAB_SIZE-aligned slabs, whose first cache
+ * line is a header naming the owner pool and the object size, so that
+ * any object can be freed from its address. Small objects (size
+ * classes of whole cache lines) are carved from the slabs of the
+ * allocating thread's pool and recycled through its free lists; an
+ * object freed by another thread is pushed on the owner's remote-free
+ * stack, which the owner takes over in one exchange when a free list
+ * runs dry. Large objects get a slab of their own from malloc.
+ *
+ * Slabs are never returned to the OS, and pools outlive their thread
+ * (its objects may still be in use): the pool of a stopped thread is
+ * adopted by the next thread that starts on the same NUMA node. The
+ * slabs of a pinned thread are bound to its node.
+ */
+
+typedef struct sstm_pool_obj
+{
+  struct sstm_pool_obj* next;
+} sstm_pool_obj_t;
+
+struct sstm_pool;
+
+typedef struct sstm_pool_slab
+{
+  struct sstm_pool* owner;	/* NULL for a large object */
+  size_t size;			/* of the objects */
+  size_t cls;
+  uint8_t padding[CACHE_LINE_SIZE - 3 * sizeof(size_t)];
+} sstm_pool_slab_t;
+
+typedef struct sstm_pool
+{
+  sstm_pool_obj_t* free[SSTM_POOL_CLASSES];
+  char* bump[SSTM_POOL_CLASSES]; /* unused part of the current slab */
+  char* bump_end[SSTM_POOL_CLASSES];
+  char* region;			/* unused part of the current region */
+  char* region_end;
+  int node;			/* NUMA node of the slabs, or -1 */
+  struct sstm_pool* next;	/* list of orphaned pools */
+  sstm_pool_obj_t* volatile remote __attribute__ ((aligned(CACHE_LINE_SIZE)));
+} __attribute__ ((aligned(CACHE_LINE_SIZE))) sstm_pool_t;
+
+static __thread sstm_pool_t* sstm_pool = NULL;
+static sstm_pool_t* sstm_pool_orphans = NULL;
+static pthread_mutex_t sstm_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline sstm_pool_slab_t*
+sstm_pool_slab_of(void* mem)
+{
+  return (sstm_pool_slab_t*) ((uintptr_t) mem & ~(SSTM_POOL_SLAB_SIZE - 1));
+}
+
+/* adopts an orphaned pool of the thread's node, or creates one
+*/
+static sstm_pool_t*
+sstm_pool_acquire()
+{
+  int node = sstm_meta.numa_node;
+  pthread_mutex_lock(&sstm_pool_lock);
+  sstm_pool_t** p = &sstm_pool_orphans;
+  while (*p != NULL && (*p)->node != node)
+    {
+      p = &(*p)->next;
+    }
+  sstm_pool_t* pool = *p;
+  if (pool != NULL)
+    {
+      *p = pool->next;
+    }
+  pthread_mutex_unlock(&sstm_pool_lock);
+
+  if (pool == NULL)
+    {
+      int ret = posix_memalign((void**) &pool, CACHE_LINE_SIZE, sizeof(sstm_pool_t));
+      assert(ret == 0);
+      memset(pool, 0, sizeof(sstm_pool_t));
+      pool->node = node;
+    }
+  return pool;
+}
+
+/* the calling thread stops: its pool waits for the next thread
+*/
+void
+sstm_pool_release()
+{
+  if (sstm_pool == NULL)
+    {
+      return;
+    }
+
+  pthread_mutex_lock(&sstm_pool_lock);
+  sstm_pool->next = sstm_pool_orphans;
+  sstm_pool_orphans = sstm_pool;
+  pthread_mutex_unlock(&sstm_pool_lock);
+  sstm_pool = NULL;
+}
+
+/* a new SSTM_POOL_SLAB_SIZE-aligned slab, from the pool's region
+*/
+static sstm_pool_slab_t*
+sstm_pool_slab_new(sstm_pool_t* pool)
+{
+  if (pool->region == pool->region_end)
+    {
+      /* map one slab more than needed, to align the region */
+      size_t len = SSTM_POOL_REGION_SIZE + SSTM_POOL_SLAB_SIZE;
+      char* mem = (char*) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED)
+	{
+	  perror("sstm: mmap pool region");
+	  exit(1);
+	}
+      char* start = (char*) (((uintptr_t) mem + SSTM_POOL_SLAB_SIZE - 1) & ~(SSTM_POOL_SLAB_SIZE - 1));
+      if (start > mem)
+	{
+	  munmap(mem, start - mem);
+	}
+      munmap(start + SSTM_POOL_REGION_SIZE, (mem + len) - (start + SSTM_POOL_REGION_SIZE));
+      sstm_numa_bind(start, SSTM_POOL_REGION_SIZE, pool->node);
+      pool->region = start;
+      pool->region_end = start + SSTM_POOL_REGION_SIZE;
+    }
+
+  sstm_pool_slab_t* slab = (sstm_pool_slab_t*) pool->region;
+  pool->region += SSTM_POOL_SLAB_SIZE;
+  return slab;
+}
+
+/* moves the objects that other threads freed to the free lists
+*/
+static void
+sstm_pool_drain(sstm_pool_t* pool)
+{
+  sstm_pool_obj_t* o = __sync_lock_test_and_set(&pool->remote, NULL);
+  while (o != NULL)
+    {
+      sstm_pool_obj_t* next = o->next;
+      size_t cls = sstm_pool_slab_of(o)->cls;
+      o->next = pool->free[cls];
+      pool->free[cls] = o;
+      o = next;
+    }
+}
+
+static void*
+sstm_pool_alloc(size_t size)
+{
+  if (__builtin_expect(size > SSTM_POOL_MAX_SIZE, 0))
+    {
+      size_t len = sizeof(sstm_pool_slab_t) + size;
+      sstm_pool_slab_t* slab;
+      int ret = posix_memalign((void**) &slab, SSTM_POOL_SLAB_SIZE, len);
+      assert(ret == 0);
+      slab->owner = NULL;
+      slab->size = size;
+      slab->cls = SSTM_POOL_CLASSES;
+      return slab + 1;
+    }
+
+  sstm_pool_t* pool = sstm_pool;
+  if (__builtin_expect(pool == NULL, 0))
+    {
+      pool = sstm_pool = sstm_pool_acquire();
+    }
+
+  size_t cls = size ? (size - 1) / SSTM_POOL_GRAIN : 0;
+  sstm_pool_obj_t* o = pool->free[cls];
+  if (__builtin_expect(o == NULL && pool->remote != NULL, 0))
+    {
+      sstm_pool_drain(pool);
+      o = pool->free[cls];
+    }
+  if (o != NULL)
+    {
+      pool->free[cls] = o->next;
+      return o;
+    }
+
+  size_t osize = (cls + 1) * SSTM_POOL_GRAIN;
+  if (pool->bump[cls] + osize > pool->bump_end[cls])
+    {
+      sstm_pool_slab_t* slab = sstm_pool_slab_new(pool);
+      slab->owner = pool;
+      slab->size = osize;
+      slab->cls = cls;
+      pool->bump[cls] = (char*) (slab + 1);
+      pool->bump_end[cls] = (char*) slab + SSTM_POOL_SLAB_SIZE;
+    }
+  void* m = pool->bump[cls];
+  pool->bump[cls] += osize;
+  return m;
+}
+
+/* returns an object to its owner: directly if we own it, otherwise
+   through the owner's remote-free stack
+*/
+static void
+sstm_pool_free(void* mem)
+{
+  sstm_pool_slab_t* slab = sstm_pool_slab_of(mem);
+  sstm_pool_t* owner = slab->owner;
+  sstm_pool_obj_t* o = (sstm_pool_obj_t*) mem;
+
+  if (__builtin_expect(owner == NULL, 0))
+    {
+      free(slab);
+    }
+  else if (owner == sstm_pool)
+    {
+      o->next = owner->free[slab->cls];
+      owner->free[slab->cls] = o;
+    }
+  else
+    {
+      sstm_pool_obj_t* head;
+      do
+	{
+	  head = owner->remote;
+	  o->next = head;
+	}
+      while (!__sync_bool_compare_and_swap(&owner->remote, head, o));
+    }
+}
+
+/* **************************************************************************************************** */
+/* epoch-based reclamation */
+/* **************************************************************************************************** */
+
+/* With invisible reads, a TX may still traverse an object that another
+ * TX unlinked and freed, so committed frees are deferred. Every
+ * optimistic TX announces the global epoch in its thread slot when it
+ * starts (and clears it when it ends): the read-only fast path only
+ * writes its own slot. The epoch advances from e to e + 1 once every
+ * running TX has announced e. An object retired (after its TX
+ * committed) in epoch e can be reached by TXs that announced e - 1 or
+ * e at most, so it is reused once the epoch is e + 2.
+ *
+ * The objects retired by a thread are batched in SSTM_EPOCH_LIMBOS
+ * lists, indexed by epoch; the thread tries to advance the epoch and
+ * reclaims the old lists every SSTM_EPOCH_BATCH retired objects.
+ */
+
+typedef struct sstm_limbo
+{
+  size_t epoch;			/* of the objects in the list */
+  size_t n;
+  size_t size;
+  void** mem;
+} sstm_limbo_t;
+
+static __thread sstm_limbo_t sstm_limbo[SSTM_EPOCH_LIMBOS];
+static __thread size_t sstm_limbo_n = 0; /* objects in the limbo lists */
+static __thread size_t sstm_limbo_next = SSTM_EPOCH_BATCH; /* reclaim at */
+
+static void
+sstm_limbo_flush(sstm_limbo_t* l)
+{
+  size_t i;
+  for (i = 0; i < l->n; i++)
+    {
+      sstm_pool_free(l->mem[i]);
+    }
+  sstm_limbo_n -= l->n;
+  l->n = 0;
+}
+
+/* is every running TX in epoch e */
+static int
+sstm_epoch_quiescent(size_t e)
+{
+  size_t i, n = sstm_meta_global.n_threads;
+  for (i = 0; i < n; i++)
+    {
+      size_t a = sstm_thread_slots[i].active;
+      if (a != 0 && a != e)
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+/* checks without a fence first: the fence (possibly a membarrier())
+   is only paid when the epoch is likely to advance
+*/
+static int
+sstm_epoch_try_advance(size_t e)
+{
+  if (!sstm_epoch_quiescent(e))
+    {
+      return 0;
+    }
+  sstm_slots_fence();
+  return sstm_epoch_quiescent(e) && __sync_bool_compare_and_swap(&sstm_meta_global.epoch, e, e + 1);
+}
+
+static void
+sstm_epoch_retire(void* mem)
+{
+  size_t e = sstm_meta_global.epoch;
+  sstm_limbo_t* l = &sstm_limbo[e % SSTM_EPOCH_LIMBOS];
+  if (l->epoch != e)
+    {
+      /* retired in epoch e - SSTM_EPOCH_LIMBOS or earlier */
+      sstm_limbo_flush(l);
+      l->epoch = e;
+    }
+
+  if (l->n == l->size)
+    {
+      l->size = l->size ? 2 * l->size : SSTM_EPOCH_BATCH;
+      l->mem = (void**) realloc(l->mem, l->size * sizeof(void*));
+      assert(l->mem != NULL);
+    }
+  l->mem[l->n++] = mem;
+  sstm_limbo_n++;
+}
+
+static void
+sstm_epoch_collect()
+{
+  size_t e = sstm_meta_global.epoch;
+  if (sstm_epoch_try_advance(e))
+    {
+      e++;
+    }
+
+  size_t i;
+  for (i = 0; i < SSTM_EPOCH_LIMBOS; i++)
+    {
+      if (sstm_limbo[i].n != 0 && sstm_limbo[i].epoch + 2 <= e)
+	{
+	  sstm_limbo_flush(&sstm_limbo[i]);
+	}
+    }
+  sstm_limbo_next = sstm_limbo_n + SSTM_EPOCH_BATCH;
+}
+
+size_t
+sstm_epoch_advance()
+{
+  size_t e = sstm_meta_global.epoch;
+  if (sstm_epoch_try_advance(e))
+    {
+      e++;
+    }
+  return e;
+}
+
+/* the thread runs no TX anymore, so it does not hold the epoch back
+*/
+void
+sstm_epoch_thread_stop()
+{
+  while (sstm_limbo_n != 0)
+    {
+      sstm_epoch_collect();
+      if (sstm_limbo_n != 0)
+	{
+	  PAUSE();
+	}
+    }
+
+  size_t i;
+  for (i = 0; i < SSTM_EPOCH_LIMBOS; i++)
+    {
+      free(sstm_limbo[i].mem);
+      sstm_limbo[i].mem = NULL;
+      sstm_limbo[i].size = 0;
+    }
+  sstm_limbo_next = SSTM_EPOCH_BATCH;
+}
+
+/* usable size of memory from sstm_tx_alloc()
+*/
+size_t
+sstm_tx_alloc_size(void* mem)
+{
+  return sstm_pool_slab_of(mem)->size;
+}
+
+void
+sstm_alloc_thread_start()
+{
+  sstm_log_init(&sstm_allocator, sizeof(void*));
+  sstm_log_init(&sstm_freeing, sizeof(void*));
+}
+
+void
+sstm_alloc_thread_stop()
+{
+  sstm_log_destroy(&sstm_allocator);
+  sstm_log_destroy(&sstm_freeing);
+}
 
 /* allocate some memory within a transaction
 */
 void*
 sstm_tx_alloc(size_t size)
 {
-  assert(sstm_allocator.n_allocs < SSTM_ALLOC_MAX_ALLOCS);
-  void* m = malloc(size);
+  void* m = sstm_pool_alloc(size);
 
   /* 
-     you need to keep track of allocations, so that if a TX
-     aborts, you free that memory
+     keep track of allocations, so that if the TX
+     aborts, we free that memory
    */
+  *(void**) sstm_log_add(&sstm_allocator) = m;
 
   return m;
 }
@@ -24,16 +427,12 @@ sstm_tx_alloc(size_t size)
 void
 sstm_tx_free(void* mem)
 {
-  assert(sstm_freeing.n_allocs < SSTM_ALLOC_MAX_ALLOCS);
-
   /* 
-     in a more complex STM systems,
-     you cannot immediately free(mem) as below because you might 
-     have TX aborts. You need to keep track of mem frees
-     and only make the actual free happen if the TX is commited
+     we cannot immediately free(mem) because the TX might
+     abort. Keep track of mem frees and only make the actual
+     free happen if the TX is commited
   */
-
-  free(mem);
+  *(void**) sstm_log_add(&sstm_freeing) = mem;
 }
 
 /* this function is executed when a transaction is aborted.
@@ -44,16 +443,69 @@ sstm_tx_free(void* mem)
 void
 sstm_alloc_on_abort()
 {
+  SSTM_LOG_FOREACH(&sstm_allocator, void*, m)
+    {
+      sstm_pool_free(*m);
+    }
+  sstm_log_clear(&sstm_allocator);
+  sstm_log_clear(&sstm_freeing);
+}
+
+void
+sstm_alloc_mark(sstm_log_pos_t* allocs, sstm_log_pos_t* frees)
+{
+  sstm_log_mark(&sstm_allocator, allocs);
+  sstm_log_mark(&sstm_freeing, frees);
+}
 
+/* a closed nested TX aborted: its allocations are freed and its frees
+   forgotten, as sstm_alloc_on_abort() does for a whole TX
+*/
+void
+sstm_alloc_rewind(const sstm_log_pos_t* allocs, const sstm_log_pos_t* frees)
+{
+  SSTM_LOG_FOREACH_SINCE(&sstm_allocator, allocs, void*, m)
+    {
+      sstm_pool_free(*m);
+    }
+  sstm_log_rewind(&sstm_allocator, allocs);
+  sstm_log_rewind(&sstm_freeing, frees);
 }
 
 /* this function is executed when a transaction is committed.
  * Purpose: (1) free any memory that was freed during the
  * transaction, (2) clean-up any allocated memory
- * references that were buffered during the transaction
+ * references that were buffered during the transaction.
+ * Optimistic TXs may still read the freed memory: it goes to the limbo
+ * lists. With GL, or in serial mode, no other TX runs: it is freed
 */
 void
 sstm_alloc_on_commit()
 {
-
+  if (sstm_freeing.n != 0)
+    {
+      if (sstm_meta_global.algo->serial && !sstm_meta.irrevocable)
+	{
+	  /* the commit's stores (that unlinked the memory) must be
+	     visible before we read the epoch */
+	  __sync_synchronize();
+	  SSTM_LOG_FOREACH(&sstm_freeing, void*, m)
+	    {
+	      sstm_epoch_retire(*m);
+	    }
+	  if (sstm_limbo_n >= sstm_limbo_next)
+	    {
+	      sstm_epoch_collect();
+	    }
+	}
+      else
+	{
+	  SSTM_LOG_FOREACH(&sstm_freeing, void*, m)
+	    {
+	      sstm_pool_free(*m);
+	    }
+	}
+      sstm_log_clear(&sstm_freeing);
+    }
+  sstm_log_clear(&sstm_allocator);
 }
@@ -0,0 +1,172 @@
+#include "sstm.h"
+#include "sstm_cm.h"
+
+/* contention managers: what a TX does when it finds a lock held by
+ * another TX (wait or abort), and before it retries after an abort.
+ */
+
+sstm_cm_slot_t sstm_cm_slots[SSTM_CM_MAX_THREADS] __attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+static inline volatile size_t*
+sstm_cm_prio(size_t id)
+{
+  return &sstm_cm_slots[id & (SSTM_CM_MAX_THREADS - 1)].prio;
+}
+
+/* does our priority beat owner's (ties are broken by thread id) */
+static inline int
+sstm_cm_wins(size_t owner)
+{
+  size_t mine = *sstm_cm_prio(sstm_meta.id);
+  size_t theirs = *sstm_cm_prio(owner);
+  return mine > theirs || (mine == theirs && sstm_meta.id < owner);
+}
+
+static inline void
+sstm_cm_spin(uint64_t cycles)
+{
+  uint64_t start = getticks();
+  while (getticks() - start < cycles)
+    {
+      PAUSE();
+    }
+}
+
+static void
+sstm_cm_nop()
+{
+}
+
+static void
+sstm_cm_nop_abort(size_t work)
+{
+}
+
+static size_t
+sstm_cm_abort_self(size_t owner)
+{
+  return 0;
+}
+
+/* backoff: waits a random time in [0, UNIT * 2^min(retries, MAX_EXP))
+*/
+static void
+sstm_cm_backoff_tx_abort(size_t work)
+{
+  size_t exp = sstm_meta.n_retries < SSTM_CM_BACKOFF_MAX_EXP ? sstm_meta.n_retries : SSTM_CM_BACKOFF_MAX_EXP;
+  uint64_t limit = (uint64_t) SSTM_CM_BACKOFF_UNIT << exp;
+  sstm_cm_spin(xorshf96(sstm_meta.cm_seeds, sstm_meta.cm_seeds + 1, sstm_meta.cm_seeds + 2) & (limit - 1));
+}
+
+/* karma: the work of aborted attempts accumulates until the TX commits
+*/
+static void
+sstm_cm_karma_tx_abort(size_t work)
+{
+  sstm_meta.cm_karma += work + 1;
+  *sstm_cm_prio(sstm_meta.id) = sstm_meta.cm_karma;
+}
+
+static void
+sstm_cm_karma_tx_commit()
+{
+  if (sstm_meta.cm_karma != 0)
+    {
+      sstm_meta.cm_karma = 0;
+      *sstm_cm_prio(sstm_meta.id) = 0;
+    }
+}
+
+static size_t
+sstm_cm_karma_conflict(size_t owner)
+{
+  return sstm_cm_wins(owner) ? SSTM_CM_WAIT_MAX : SSTM_CM_KARMA_WAIT;
+}
+
+/* greedy and timestamp: the start time of the first attempt, negated so
+   that older transactions have a higher priority
+*/
+static void
+sstm_cm_timestamp_tx_start()
+{
+  *sstm_cm_prio(sstm_meta.id) = ~getticks();
+}
+
+static size_t
+sstm_cm_greedy_conflict(size_t owner)
+{
+  return sstm_cm_wins(owner) ? SSTM_CM_WAIT_MAX : 0;
+}
+
+/* the younger TX has released its locks: now it can wait for the
+   older one without risking a deadlock
+*/
+static void
+sstm_cm_greedy_tx_abort(size_t work)
+{
+  if (sstm_meta.cm_enemy != NULL)
+    {
+      sstm_cm_wait(sstm_meta.cm_enemy, sstm_meta.cm_enemy_orec, SSTM_CM_WAIT_MAX);
+    }
+}
+
+static size_t
+sstm_cm_timestamp_conflict(size_t owner)
+{
+  return sstm_cm_wins(owner) ? SSTM_CM_TIMESTAMP_WAIT : 0;
+}
+
+static const sstm_cm_t sstm_cm_none =
+  {
+    .name = "none",
+    .tx_start = sstm_cm_nop,
+    .tx_abort = sstm_cm_nop_abort,
+    .tx_commit = sstm_cm_nop,
+    .conflict = sstm_cm_abort_self,
+  };
+
+static const sstm_cm_t sstm_cm_backoff =
+  {
+    .name = "backoff",
+    .tx_start = sstm_cm_nop,
+    .tx_abort = sstm_cm_backoff_tx_abort,
+    .tx_commit = sstm_cm_nop,
+    .conflict = sstm_cm_abort_self,
+  };
+
+static const sstm_cm_t sstm_cm_karma =
+  {
+    .name = "karma",
+    .tx_start = sstm_cm_nop,
+    .tx_abort = sstm_cm_karma_tx_abort,
+    .tx_commit = sstm_cm_karma_tx_commit,
+    .conflict = sstm_cm_karma_conflict,
+  };
+
+static const sstm_cm_t sstm_cm_greedy =
+  {
+    .name = "greedy",
+    .tx_start = sstm_cm_timestamp_tx_start,
+    .tx_abort = sstm_cm_greedy_tx_abort,
+    .tx_commit = sstm_cm_nop,
+    .conflict = sstm_cm_greedy_conflict,
+  };
+
+static const sstm_cm_t sstm_cm_timestamp =
+  {
+    .name = "timestamp",
+    .tx_start = sstm_cm_timestamp_tx_start,
+    .tx_abort = sstm_cm_nop_abort,
+    .tx_commit = sstm_cm_nop,
+    .conflict = sstm_cm_timestamp_conflict,
+  };
+
+/* indexed by sstm_cm_id_t */
+const sstm_cm_t* sstm_cms[SSTM_CM_NUM] =
+  {
+    &sstm_cm_none,
+    &sstm_cm_backoff,
+    &sstm_cm_karma,
+    &sstm_cm_greedy,
+    &sstm_cm_timestamp,
+  };
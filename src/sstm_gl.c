@@ -0,0 +1,74 @@
+#include "sstm.h"
+
+/* GL-STM: every transaction runs under the global lock, so
+   transactions never abort (unless TX_ABORT() is called).
+*/
+
+static void
+sstm_gl_start()
+{
+}
+
+static void
+sstm_gl_stop()
+{
+}
+
+static void
+sstm_gl_thread_start()
+{
+}
+
+static void
+sstm_gl_thread_stop()
+{
+}
+
+/* starts a transaction by acquiring the global lock
+*/
+static void
+sstm_gl_tx_start()
+{
+  LOCK(&sstm_meta_global.glock);
+}
+
+/* loads and stores access memory directly (see sstm_tx_load() and
+   sstm_tx_store() in sstm.h)
+*/
+
+/* cleaning up in case of an abort 
+   (e.g., flush the read or write logs)
+*/
+static void
+sstm_gl_tx_cleanup()
+{
+  UNLOCK(&sstm_meta_global.glock);
+  sstm_alloc_on_abort();
+  sstm_meta.n_aborts++;
+}
+
+/* tries to commit a transaction
+   (e.g., validates some version number, and/or
+   acquires a couple of locks)
+ */
+static void
+sstm_gl_tx_commit()
+{
+  UNLOCK(&sstm_meta_global.glock);	       
+  sstm_alloc_on_commit();
+  sstm_meta.n_commits++;		
+}
+
+const sstm_algo_t sstm_algo_gl =
+  {
+    .name = "gl",
+    .read_only = 0,
+    .serial = 0,
+    .start = sstm_gl_start,
+    .stop = sstm_gl_stop,
+    .thread_start = sstm_gl_thread_start,
+    .thread_stop = sstm_gl_thread_stop,
+    .tx_start = sstm_gl_tx_start,
+    .tx_cleanup = sstm_gl_tx_cleanup,
+    .tx_commit = sstm_gl_tx_commit,
+  };
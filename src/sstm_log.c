@@ -0,0 +1,76 @@
+#include <string.h>
+
+#include "sstm.h"
+
+/* transaction log chunks: allocated the first time a log grows that
+ * far, and kept (in the list) until the thread stops.
+ */
+
+static sstm_log_chunk_t*
+sstm_log_chunk_new(size_t esize, size_t cap)
+{
+  sstm_log_chunk_t* c;
+  if (posix_memalign((void**) &c, CACHE_LINE_SIZE, SSTM_LOG_CHUNK_SIZE) != 0)
+    {
+      return NULL;
+    }
+  c->next = NULL;
+  c->prev = NULL;
+  c->end = c->entries + cap * esize;
+  return c;
+}
+
+void
+sstm_log_init_cap(sstm_log_t* log, size_t esize, size_t cap)
+{
+  assert(cap > 0 && cap * esize <= SSTM_LOG_CHUNK_SIZE - sizeof(sstm_log_chunk_t));
+  log->esize = esize;
+  log->cap = cap;
+  log->first = sstm_log_chunk_new(esize, cap);
+  assert(log->first != NULL);
+  sstm_log_clear(log);
+}
+
+void
+sstm_log_init(sstm_log_t* log, size_t esize)
+{
+  sstm_log_init_cap(log, esize, (SSTM_LOG_CHUNK_SIZE - sizeof(sstm_log_chunk_t)) / esize);
+}
+
+void
+sstm_log_destroy(sstm_log_t* log)
+{
+  sstm_log_chunk_t* c = log->first;
+  while (c != NULL)
+    {
+      sstm_log_chunk_t* next = c->next;
+      free(c);
+      c = next;
+    }
+  memset(log, 0, sizeof(sstm_log_t));
+}
+
+void
+sstm_log_extend(sstm_log_t* log)
+{
+  sstm_log_chunk_t* c = log->chunk->next;
+  if (c == NULL)
+    {
+      c = sstm_log_chunk_new(log->esize, log->cap);
+      if (c == NULL)
+	{
+	  if (sstm_meta.irrevocable || !sstm_meta_global.algo->serial)
+	    {
+	      fprintf(stderr, "sstm: out of memory for the transaction logs\n");
+	      abort();
+	    }
+	  sstm_tx_abort(SSTM_ABORT_CAPACITY);
+	}
+      c->prev = log->chunk;
+      log->chunk->next = c;
+    }
+
+  log->chunk = c;
+  log->cur = c->entries;
+  log->end = c->end;
+}
@@ -0,0 +1,642 @@
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "sstm.h"
+#include "sstm_clock.h"
+#include "sstm_cm.h"
+#include "sstm_validate.h"
+
+/* MVCC: TL2 plus a bounded chain of past versions per stripe. Update
+ * transactions run as in TL2 and, at commit, archive the values they
+ * overwrite in the chains of their stripes, stamped with the commit
+ * time. Read-only transactions read the snapshot as of their start:
+ * the current value if its stripe is not newer, the archived one
+ * otherwise. They do not log their reads nor validate, and only abort
+ * if a version they need was dropped from a chain that grew beyond
+ * SSTM_MVCC_VERSIONS. A background thread trims the versions that no
+ * running snapshot can read.
+ *
+ * Versions come from slabs of SSTM_MVCC_BATCH. Every thread allocates
+ * from its own list of free versions; the collector hands the versions
+ * it reclaims back in lists of SSTM_MVCC_BATCH, which threads take when
+ * theirs runs short. The slabs are freed at sstm_stop().
+ */
+
+/* the value addr had before until (the commit time of the TX that
+   overwrote it). A chain goes from the newest version to the oldest */
+typedef struct sstm_mvcc_version
+{
+  struct sstm_mvcc_version* volatile next;
+  volatile uintptr_t* addr;
+  uintptr_t val;
+  size_t until;
+  volatile size_t cut;		/* end of a trimmed chain: until of the newest version dropped */
+} sstm_mvcc_version_t;
+
+typedef struct sstm_mvcc_slab
+{
+  struct sstm_mvcc_slab* next;
+  sstm_mvcc_version_t versions[SSTM_MVCC_BATCH];
+} sstm_mvcc_slab_t;
+
+/* versions unlinked by the collector, freed 2 epochs later */
+typedef struct sstm_mvcc_limbo
+{
+  size_t epoch;
+  size_t n;
+  size_t size;
+  sstm_mvcc_version_t** chains;
+} sstm_mvcc_limbo_t;
+
+static sstm_mvcc_version_t* volatile* sstm_mvcc_chains; /* indexed like the orecs */
+static size_t sstm_mvcc_chains_bytes;
+static volatile uint8_t* sstm_mvcc_dirty; /* per group of chains: may hold versions */
+static size_t sstm_mvcc_n;	/* chains */
+static size_t sstm_mvcc_groups;
+static sstm_mvcc_limbo_t sstm_mvcc_limbo[SSTM_EPOCH_LIMBOS];
+static pthread_t sstm_mvcc_collector;
+static volatile int sstm_mvcc_collecting;
+
+static pthread_mutex_t sstm_mvcc_free_lock = PTHREAD_MUTEX_INITIALIZER;
+static sstm_mvcc_slab_t* sstm_mvcc_slabs = NULL;
+static sstm_mvcc_limbo_t sstm_mvcc_free;	/* lists of free versions */
+static sstm_mvcc_version_t* sstm_mvcc_freeing = NULL; /* by the collector */
+static size_t sstm_mvcc_freeing_n = 0;
+static __thread sstm_mvcc_version_t* sstm_mvcc_cache = NULL; /* free versions of the thread */
+static __thread size_t sstm_mvcc_cache_n = 0;
+
+static inline size_t
+sstm_mvcc_chain(volatile uintptr_t* addr)
+{
+  return sstm_orec_index(&sstm_meta_global.orecs, addr);
+}
+
+static inline size_t
+sstm_mvcc_group_end(size_t g)
+{
+  size_t end = (g + 1) << SSTM_MVCC_GROUP_SHIFT;
+  return end < sstm_mvcc_n ? end : sstm_mvcc_n;
+}
+
+/* **************************************************************************************************** */
+/* version collector */
+/* **************************************************************************************************** */
+
+static void
+sstm_mvcc_limbo_add(sstm_mvcc_limbo_t* l, sstm_mvcc_version_t* v)
+{
+  if (l->n == l->size)
+    {
+      l->size = l->size ? 2 * l->size : SSTM_EPOCH_BATCH;
+      l->chains = (sstm_mvcc_version_t**) realloc(l->chains, l->size * sizeof(sstm_mvcc_version_t*));
+      assert(l->chains != NULL);
+    }
+  l->chains[l->n++] = v;
+}
+
+/* makes sure the calling thread has n free versions: commits reserve
+   them before they take any lock. returns 0 if out of memory
+*/
+static int
+sstm_mvcc_reserve(size_t n)
+{
+  while (sstm_mvcc_cache_n < n)
+    {
+      sstm_mvcc_version_t* list = NULL;
+      pthread_mutex_lock(&sstm_mvcc_free_lock);
+      if (sstm_mvcc_free.n != 0)
+	{
+	  list = sstm_mvcc_free.chains[--sstm_mvcc_free.n];
+	}
+      else
+	{
+	  sstm_mvcc_slab_t* s = (sstm_mvcc_slab_t*) malloc(sizeof(sstm_mvcc_slab_t));
+	  if (s != NULL)
+	    {
+	      size_t i;
+	      for (i = 0; i < SSTM_MVCC_BATCH; i++)
+		{
+		  s->versions[i].next = (i + 1 < SSTM_MVCC_BATCH) ? &s->versions[i + 1] : NULL;
+		}
+	      s->next = sstm_mvcc_slabs;
+	      sstm_mvcc_slabs = s;
+	      list = &s->versions[0];
+	    }
+	}
+      pthread_mutex_unlock(&sstm_mvcc_free_lock);
+      if (list == NULL)
+	{
+	  return 0;
+	}
+
+      sstm_mvcc_version_t* tail = list;
+      size_t k = 1;
+      while (tail->next != NULL)
+	{
+	  tail = tail->next;
+	  k++;
+	}
+      tail->next = sstm_mvcc_cache;
+      sstm_mvcc_cache = list;
+      sstm_mvcc_cache_n += k;
+    }
+  return 1;
+}
+
+/* (collector) the versions of chain v are free again */
+static void
+sstm_mvcc_recycle(sstm_mvcc_version_t* v)
+{
+  while (v != NULL)
+    {
+      sstm_mvcc_version_t* next = v->next;
+      v->next = sstm_mvcc_freeing;
+      sstm_mvcc_freeing = v;
+      if (++sstm_mvcc_freeing_n == SSTM_MVCC_BATCH)
+	{
+	  pthread_mutex_lock(&sstm_mvcc_free_lock);
+	  sstm_mvcc_limbo_add(&sstm_mvcc_free, sstm_mvcc_freeing);
+	  pthread_mutex_unlock(&sstm_mvcc_free_lock);
+	  sstm_mvcc_freeing = NULL;
+	  sstm_mvcc_freeing_n = 0;
+	}
+      v = next;
+    }
+}
+
+static void
+sstm_mvcc_limbo_flush(sstm_mvcc_limbo_t* l)
+{
+  size_t i;
+  for (i = 0; i < l->n; i++)
+    {
+      sstm_mvcc_recycle(l->chains[i]);
+    }
+  l->n = 0;
+}
+
+/* the oldest snapshot of the running read-only TXs, or the clock. A
+   TX announces its snapshot (plus 1) before it reads the clock again
+   for its actual one, with a fence in between: if we miss the
+   announcement, its snapshot is not older than the clock we read first
+*/
+static size_t
+sstm_mvcc_horizon()
+{
+  size_t h = sstm_clock_read() + 1;
+  size_t i, n = sstm_meta_global.n_threads;
+  for (i = 0; i < n; i++)
+    {
+      size_t s = sstm_thread_slots[i].snapshot;
+      if (s != 0 && s < h)
+	{
+	  h = s;
+	}
+    }
+  return h - 1;
+}
+
+/* trims chain i: versions not newer than the horizon are read by no
+   snapshot, and at most SSTM_MVCC_VERSIONS are kept. Only the lock
+   holder of the stripe pushes versions (at the head), so the head is
+   only unlinked under the lock. returns the versions left
+*/
+static size_t
+sstm_mvcc_trim(size_t i, size_t horizon, sstm_mvcc_limbo_t* unlinked)
+{
+  sstm_mvcc_version_t* v = sstm_mvcc_chains[i];
+  if (v == NULL)
+    {
+      return 0;
+    }
+
+  if (v->until <= horizon)
+    {
+      const sstm_orec_table_t* t = &sstm_meta_global.orecs;
+      sstm_orec_t* orec = &t->orecs[i << t->stride];
+      uintptr_t o = *orec;
+      if (OREC_IS_LOCKED(o) || !__sync_bool_compare_and_swap(orec, o, OREC_LOCKED_BY(o, SSTM_MVCC_OWNER)))
+	{
+	  return 1;		/* next time */
+	}
+      v = sstm_mvcc_chains[i];
+      if (v->until <= horizon)
+	{
+	  sstm_mvcc_chains[i] = NULL;
+	  COMPILER_NO_REORDER(*orec = o;);
+	  sstm_mvcc_limbo_add(unlinked, v);
+	  return 0;
+	}
+      COMPILER_NO_REORDER(*orec = o;);	/* a commit pushed a version in between */
+    }
+
+  size_t n = 1;
+  sstm_mvcc_version_t* next;
+  while ((next = v->next) != NULL)
+    {
+      if (next->until <= horizon || n == SSTM_MVCC_VERSIONS)
+	{
+	  if (next->until > horizon)
+	    {
+	      v->cut = next->until;
+	    }
+	  COMPILER_NO_REORDER(v->next = NULL;);
+	  sstm_mvcc_limbo_add(unlinked, next);
+	  break;
+	}
+      v = next;
+      n++;
+    }
+  return n;
+}
+
+/* one pass over the chains that may hold versions: the unlinked
+   versions wait (like TX_FREE()d memory, see sstm_alloc.c) until no
+   TX that started before they were unlinked is running
+*/
+static void
+sstm_mvcc_collect()
+{
+  static sstm_mvcc_limbo_t unlinked;
+  size_t horizon = sstm_mvcc_horizon();
+  size_t g;
+  for (g = 0; g < sstm_mvcc_groups; g++)
+    {
+      if (!sstm_mvcc_dirty[g])
+	{
+	  continue;
+	}
+      /* a commit that pushes after we read its chain marks it again */
+      sstm_mvcc_dirty[g] = 0;
+      __sync_synchronize();
+
+      size_t i, left = 0;
+      size_t end = sstm_mvcc_group_end(g);
+      for (i = g << SSTM_MVCC_GROUP_SHIFT; i < end; i++)
+	{
+	  left += sstm_mvcc_trim(i, horizon, &unlinked);
+	}
+      if (left)
+	{
+	  sstm_mvcc_dirty[g] = 1;
+	}
+    }
+
+  __sync_synchronize();
+  size_t e = sstm_meta_global.epoch;
+  if (unlinked.n != 0)
+    {
+      sstm_mvcc_limbo_t* l = &sstm_mvcc_limbo[e % SSTM_EPOCH_LIMBOS];
+      if (l->epoch != e)
+	{
+	  sstm_mvcc_limbo_flush(l);
+	  l->epoch = e;
+	}
+      size_t i;
+      for (i = 0; i < unlinked.n; i++)
+	{
+	  sstm_mvcc_limbo_add(l, unlinked.chains[i]);
+	}
+      unlinked.n = 0;
+    }
+
+  e = sstm_epoch_advance();
+  int i;
+  for (i = 0; i < SSTM_EPOCH_LIMBOS; i++)
+    {
+      if (sstm_mvcc_limbo[i].n != 0 && sstm_mvcc_limbo[i].epoch + 2 <= e)
+	{
+	  sstm_mvcc_limbo_flush(&sstm_mvcc_limbo[i]);
+	}
+    }
+}
+
+static void*
+sstm_mvcc_collector_run(void* arg)
+{
+  while (sstm_mvcc_collecting)
+    {
+      usleep(SSTM_MVCC_GC_PERIOD);
+      sstm_mvcc_collect();
+    }
+  return NULL;
+}
+
+/* **************************************************************************************************** */
+/* algorithm */
+/* **************************************************************************************************** */
+
+static void
+sstm_mvcc_start()
+{
+  sstm_orecs_create();
+
+  sstm_mvcc_n = sstm_meta_global.orecs.mask + 1;
+  sstm_mvcc_chains_bytes = sstm_mvcc_n * sizeof(sstm_mvcc_version_t*);
+  void* mem = mmap(NULL, sstm_mvcc_chains_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    {
+      perror("sstm: mmap version chains");
+      exit(1);
+    }
+  sstm_mvcc_chains = (sstm_mvcc_version_t* volatile*) mem;
+  sstm_mvcc_groups = (sstm_mvcc_n + (1UL << SSTM_MVCC_GROUP_SHIFT) - 1) >> SSTM_MVCC_GROUP_SHIFT;
+  sstm_mvcc_dirty = (volatile uint8_t*) calloc(sstm_mvcc_groups, 1);
+  assert(sstm_mvcc_dirty != NULL);
+
+  sstm_mvcc_collecting = 1;
+  if (pthread_create(&sstm_mvcc_collector, NULL, sstm_mvcc_collector_run, NULL) != 0)
+    {
+      perror("sstm: version collector");
+      exit(1);
+    }
+}
+
+/* no TX runs anymore: every version goes with the slabs */
+static void
+sstm_mvcc_stop()
+{
+  sstm_mvcc_collecting = 0;
+  pthread_join(sstm_mvcc_collector, NULL);
+
+  while (sstm_mvcc_slabs != NULL)
+    {
+      sstm_mvcc_slab_t* next = sstm_mvcc_slabs->next;
+      free(sstm_mvcc_slabs);
+      sstm_mvcc_slabs = next;
+    }
+  size_t i;
+  for (i = 0; i < SSTM_EPOCH_LIMBOS; i++)
+    {
+      free(sstm_mvcc_limbo[i].chains);
+      memset(&sstm_mvcc_limbo[i], 0, sizeof(sstm_mvcc_limbo_t));
+    }
+  free(sstm_mvcc_free.chains);
+  memset(&sstm_mvcc_free, 0, sizeof(sstm_mvcc_limbo_t));
+  sstm_mvcc_freeing = NULL;
+  sstm_mvcc_freeing_n = 0;
+  free((void*) sstm_mvcc_dirty);
+  munmap((void*) sstm_mvcc_chains, sstm_mvcc_chains_bytes);
+  sstm_orecs_destroy();
+}
+
+static void
+sstm_mvcc_thread_start()
+{
+  sstm_thread_slots[sstm_meta.id].snapshot = 0;
+  sstm_read_set_init(&sstm_meta.read_set);
+  sstm_write_set_init(&sstm_meta.write_set);
+}
+
+static void
+sstm_mvcc_thread_stop()
+{
+  if (sstm_mvcc_cache != NULL)
+    {
+      pthread_mutex_lock(&sstm_mvcc_free_lock);
+      sstm_mvcc_limbo_add(&sstm_mvcc_free, sstm_mvcc_cache);
+      pthread_mutex_unlock(&sstm_mvcc_free_lock);
+      sstm_mvcc_cache = NULL;
+      sstm_mvcc_cache_n = 0;
+    }
+  sstm_read_set_destroy(&sstm_meta.read_set);
+  sstm_write_set_destroy(&sstm_meta.write_set);
+}
+
+/* takes a snapshot of the global clock; read-only TXs announce it
+   to the collector first
+*/
+static void
+sstm_mvcc_tx_start()
+{
+  if (sstm_meta.ro)
+    {
+      sstm_thread_slots[sstm_meta.id].snapshot = sstm_clock_read() + 1;
+      __sync_synchronize();
+    }
+  sstm_meta.start_ts = sstm_clock_read();
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+}
+
+/* reads the value addr had at the snapshot: the orec is read as in
+ * TL2, but a locked one is waited for (it belongs to a committing TX,
+ * or to the collector). If the stripe changed after the snapshot, the
+ * commits that did it archived their old values before releasing the
+ * orec: the oldest version of addr newer than the snapshot holds its
+ * value then, and if there is none, addr has not changed since.
+*/
+static inline uintptr_t
+sstm_mvcc_snapshot_load(volatile uintptr_t* addr)
+{
+  sstm_orec_t* orec = sstm_orec_get(&sstm_meta_global.orecs, addr);
+  const size_t start_ts = sstm_meta.start_ts;
+  uintptr_t o, val;
+  size_t spins = 0;
+  while (1)
+    {
+      o = *orec;
+      if (OREC_IS_LOCKED(o))
+	{
+	  if (++spins % SSTM_MVCC_SPIN == 0)
+	    {
+	      sched_yield();	/* the owner may have been preempted */
+	    }
+	  PAUSE();
+	  continue;
+	}
+      COMPILER_BARRIER();
+      val = *addr;
+      COMPILER_BARRIER();
+      if (o == *orec)
+	{
+	  break;
+	}
+    }
+  if (OREC_VERSION(o) <= start_ts)
+    {
+      return val;
+    }
+
+  sstm_clock_observe(OREC_VERSION(o));
+  sstm_mvcc_version_t* last = NULL;
+  sstm_mvcc_version_t* v = sstm_mvcc_chains[sstm_mvcc_chain(addr)];
+  for (; v != NULL && v->until > start_ts; v = v->next)
+    {
+      if (v->addr == addr)
+	{
+	  val = v->val;
+	}
+      last = v;
+    }
+  if (v == NULL && last != NULL && last->cut > start_ts)
+    {
+      sstm_tx_abort(SSTM_ABORT_SNAPSHOT);
+    }
+  return val;
+}
+
+/* transactionally reads the value of addr: from the snapshot in
+   read-only mode, as in TL2 otherwise
+*/
+inline uintptr_t
+sstm_mvcc_tx_load(volatile uintptr_t* addr)
+{
+  if (sstm_meta.ro)
+    {
+      return sstm_mvcc_snapshot_load(addr);
+    }
+  return sstm_tl2_tx_load(addr);
+}
+
+void
+sstm_mvcc_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n)
+{
+  if (!sstm_meta.ro)
+    {
+      sstm_tl2_tx_load_range(dst, src, n);
+      return;
+    }
+
+  size_t i;
+  for (i = 0; i < n; i++)
+    {
+      dst[i] = sstm_mvcc_snapshot_load(src + i);
+    }
+}
+
+/* (stores are buffered by sstm_tl2_tx_store()) */
+
+/* releases the orecs acquired during an unsuccessful commit,
+   restoring the version they had before
+*/
+static inline void
+sstm_mvcc_unlock_write_set()
+{
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      if (w->locked)
+	{
+	  *w->orec = OREC_UNLOCKED(*w->orec);
+	  w->locked = 0;
+	}
+    }
+}
+
+static void
+sstm_mvcc_tx_cleanup()
+{
+  sstm_thread_slots[sstm_meta.id].snapshot = 0;
+  sstm_mvcc_unlock_write_set();
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+  sstm_alloc_on_abort();
+  sstm_meta.n_aborts++;
+}
+
+/* tries to commit a transaction: read-only TXs have nothing to check;
+   update TXs commit as in TL2, but archive the values they overwrite
+   before writing back
+ */
+static void
+sstm_mvcc_tx_commit()
+{
+  if (sstm_meta.write_set.log.n == 0)
+    {
+      sstm_thread_slots[sstm_meta.id].snapshot = 0;
+      sstm_log_clear(&sstm_meta.read_set);
+      sstm_alloc_on_commit();
+      sstm_meta.n_commits++;
+      return;
+    }
+
+  if (!sstm_mvcc_reserve(sstm_meta.write_set.log.n))
+    {
+      sstm_tx_abort(SSTM_ABORT_CAPACITY);
+    }
+
+  const size_t id = sstm_meta.id;
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      uintptr_t o = *w->orec;
+      while (OREC_IS_LOCKED(o) && OREC_OWNER(o) != id)
+	{
+	  if (!sstm_cm_conflict(w->orec, o))
+	    {
+	      sstm_tx_abort(SSTM_ABORT_WW_CONFLICT);
+	    }
+	  o = *w->orec;
+	}
+      if (OREC_IS_LOCKED(o))
+	{
+	  continue;		/* another address on the same stripe */
+	}
+      if (!__sync_bool_compare_and_swap(w->orec, o, OREC_LOCKED_BY(o, id)))
+	{
+	  sstm_tx_abort(SSTM_ABORT_WW_CONFLICT);
+	}
+      w->locked = 1;
+    }
+
+  int validate;
+  size_t commit_ts = sstm_clock_commit(sstm_meta.start_ts, &validate);
+  if (validate && !sstm_validate_versions(sstm_meta_global.validate, &sstm_meta.read_set, id, sstm_meta.start_ts))
+    {
+      sstm_tx_abort(SSTM_ABORT_VALIDATION);
+    }
+
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      sstm_mvcc_version_t* v = sstm_mvcc_cache;
+      sstm_mvcc_cache = v->next;
+      sstm_mvcc_cache_n--;
+      size_t c = sstm_mvcc_chain(w->addr);
+      v->addr = w->addr;
+      v->val = *w->addr;
+      v->until = commit_ts;
+      v->cut = 0;
+      v->next = sstm_mvcc_chains[c];
+      COMPILER_NO_REORDER(sstm_mvcc_chains[c] = v;);
+      sstm_mvcc_dirty[c >> SSTM_MVCC_GROUP_SHIFT] = 1;
+    }
+  COMPILER_BARRIER();
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      *w->addr = w->val;
+    }
+  COMPILER_BARRIER();
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      if (w->locked)
+	{
+	  *w->orec = OREC_MAKE(commit_ts);
+	  w->locked = 0;
+	}
+    }
+  /* with deferred increments (gv5, gv6), the clock may still be below
+     commit_ts: a snapshot taken from it afterwards would be older than
+     this commit and read the archived values, without ever aborting */
+  sstm_clock_observe(commit_ts);
+
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+  sstm_alloc_on_commit();
+  sstm_meta.n_commits++;
+}
+
+const sstm_algo_t sstm_algo_mvcc =
+  {
+    .name = "mvcc",
+    .read_only = 1,
+    .serial = 1,
+    .start = sstm_mvcc_start,
+    .stop = sstm_mvcc_stop,
+    .thread_start = sstm_mvcc_thread_start,
+    .thread_stop = sstm_mvcc_thread_stop,
+    .tx_start = sstm_mvcc_tx_start,
+    .tx_cleanup = sstm_mvcc_tx_cleanup,
+    .tx_commit = sstm_mvcc_tx_commit,
+    .tx_rollback = sstm_tl2_tx_rollback, /* update TXs only */
+  };
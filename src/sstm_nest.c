@@ -0,0 +1,112 @@
+#include "sstm.h"
+#include "sstm_cm.h"
+
+/* nested transactions. By default (flat nesting) a TX_START() inside a
+ * TX only counts the nesting depth, and the nested TX is part of its
+ * parent: any abort restarts the outermost TX. With closed nesting, a
+ * nested TX records where the transaction logs were when it started
+ * and gets its own restart point: a conflict detected while it runs
+ * truncates the logs back to those positions and retries the nested TX
+ * alone, after extending the snapshot of the TX to the current time.
+ * If the reads of the parent are not valid anymore (or the nested TX
+ * retried SSTM_NEST_RETRIES times), the parent is rolled back the same
+ * way, up to the outermost TX. Commits of nested TXs only pop them: the
+ * accesses become their parent's and are validated at the outermost
+ * commit.
+ */
+
+/* read-only and serial-mode TXs do not roll back nested TXs: the
+   former have no read set to extend their snapshot with, the latter
+   cannot abort
+*/
+sstm_nest_level_t*
+sstm_nest_push()
+{
+  sstm_meta.nesting++;
+  if (!sstm_meta_global.nesting_closed || sstm_meta.ro || sstm_meta.irrevocable
+      || sstm_meta_global.algo->tx_rollback == NULL || sstm_meta.nest_n == SSTM_NEST_MAX)
+    {
+      return NULL;
+    }
+
+  sstm_nest_level_t* l = &sstm_meta.nest[sstm_meta.nest_n++];
+  l->depth = sstm_meta.nesting;
+  l->retries = 0;
+  sstm_log_mark(&sstm_meta.read_set, &l->read_set);
+  sstm_log_mark(&sstm_meta.write_set.log, &l->write_set);
+  sstm_log_mark(&sstm_meta.undo_log, &l->undo_log);
+  sstm_log_mark(&sstm_meta.nest_log, &l->nest_log);
+  sstm_alloc_mark(&l->allocs, &l->frees);
+  return l;
+}
+
+void
+sstm_nest_commit()
+{
+  if (sstm_meta.nest_n > 0 && sstm_meta.nest[sstm_meta.nest_n - 1].depth == sstm_meta.nesting)
+    {
+      if (--sstm_meta.nest_n == 0)
+	{
+	  sstm_log_clear(&sstm_meta.nest_log);
+	}
+    }
+  sstm_meta.nesting--;
+}
+
+/* the write set of a write-back algorithm: the entries added by the
+   nested TX are dropped, and the ones it overwrote get their old value
+   back (the last one saved is the oldest)
+*/
+void
+sstm_nest_write_set_rewind(const sstm_nest_level_t* l)
+{
+  sstm_write_set_rewind(&sstm_meta.write_set, &l->write_set);
+  SSTM_LOG_FOREACH_REVERSE_SINCE(&sstm_meta.nest_log, &l->nest_log, sstm_write_entry_t, u)
+    {
+      sstm_write_entry_t* w = sstm_write_set_find(&sstm_meta.write_set, u->addr);
+      if (w != NULL)
+	{
+	  w->val = u->val;
+	}
+    }
+  sstm_log_rewind(&sstm_meta.nest_log, &l->nest_log);
+}
+
+/* back at the restart point of l after a conflict: the rollback is
+   accounted as an abort (of the TX's site) once it lands, either here
+   or, if l cannot be retried, in its parent
+*/
+void
+sstm_nest_rollback(sstm_nest_level_t* l, int reason)
+{
+  assert(l == &sstm_meta.nest[sstm_meta.nest_n - 1]);
+  assert(reason > 0 && reason < SSTM_ABORT_NUM);
+  size_t work = (sstm_meta.read_set.n - l->read_set.n) + (sstm_meta.write_set.log.n - l->write_set.n)
+    + (sstm_meta.undo_log.n - l->undo_log.n);
+
+  sstm_alloc_rewind(&l->allocs, &l->frees);
+  int valid = sstm_meta_global.algo->tx_rollback(l, reason);
+  sstm_cm_wake();
+  sstm_meta.nesting = l->depth;
+  sstm_meta.cm_enemy = NULL;
+
+  if (sstm_meta_global.serial_after && sstm_meta.n_retries + 1 >= sstm_meta_global.serial_after)
+    {
+      /* the outermost TX goes serial */
+      sstm_meta.nest_n = 0;
+      sstm_tx_abort(reason);
+    }
+  if (!valid || ++l->retries > SSTM_NEST_RETRIES)
+    {
+      sstm_meta.nest_n--;
+      sstm_tx_abort(reason);
+    }
+
+  sstm_meta.n_aborts++;
+  sstm_meta.n_retries++;
+  sstm_meta.stats.n_aborts++;
+  sstm_meta.stats.n_aborts_nested++;
+  sstm_meta.site_stats_cur->n_aborts++;
+  sstm_meta.stats.aborts[reason]++;
+  sstm_meta_global.cm->tx_abort(work);
+}
@@ -0,0 +1,236 @@
+#include "sstm.h"
+#include "sstm_validate.h"
+
+/* NORec: no per-location metadata, a single global sequence lock
+ * (odd while a writer is writing back). Reads log the values they
+ * observed and are revalidated by value whenever the sequence number
+ * moves; writes are buffered and written back under the sequence lock.
+ */
+
+static void
+sstm_norec_start()
+{
+  sstm_meta_global.seqlock = 0;
+}
+
+static void
+sstm_norec_stop()
+{
+}
+
+static void
+sstm_norec_thread_start()
+{
+  sstm_read_set_init(&sstm_meta.read_set);
+  sstm_write_set_init(&sstm_meta.write_set);
+}
+
+static void
+sstm_norec_thread_stop()
+{
+  sstm_read_set_destroy(&sstm_meta.read_set);
+  sstm_write_set_destroy(&sstm_meta.write_set);
+}
+
+/* waits until no writer is writing back and returns the sequence number
+*/
+static inline size_t
+sstm_norec_wait_even()
+{
+  size_t s;
+  while ((s = sstm_meta_global.seqlock) & 1)
+    {
+      PAUSE();
+    }
+  return s;
+}
+
+/* revalidates the read set by value: returns 1 and the sequence number
+   at which the read set was consistent in *ts, or 0 if a value changed
+*/
+static int
+sstm_norec_revalidate(size_t* ts)
+{
+  while (1)
+    {
+      size_t s = sstm_norec_wait_even();
+      COMPILER_BARRIER();
+
+      if (!sstm_validate_values(sstm_meta_global.validate, &sstm_meta.read_set))
+	{
+	  return 0;
+	}
+
+      COMPILER_BARRIER();
+      if (s == sstm_meta_global.seqlock)
+	{
+	  *ts = s;
+	  return 1;
+	}
+    }
+}
+
+/* revalidates the read set and returns the new snapshot; aborts if a
+   value changed
+*/
+static size_t
+sstm_norec_validate()
+{
+  size_t s;
+  if (!sstm_norec_revalidate(&s))
+    {
+      sstm_tx_abort(SSTM_ABORT_VALIDATION);
+    }
+  return s;
+}
+
+/* takes a snapshot of the sequence lock
+*/
+static void
+sstm_norec_tx_start()
+{
+  sstm_meta.start_ts = sstm_norec_wait_even();
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+}
+
+/* transactionally reads the value of addr:
+ * if the sequence number moved since the snapshot, the read set is
+ * revalidated and the snapshot extended before the value is returned
+*/
+inline uintptr_t
+sstm_norec_tx_load(volatile uintptr_t* addr)
+{
+  if (sstm_meta.write_set.log.n > 0)
+    {
+      sstm_write_entry_t* w = sstm_write_set_find(&sstm_meta.write_set, addr);
+      if (w != NULL)
+	{
+	  return w->val;
+	}
+    }
+
+  uintptr_t val = *addr;
+  COMPILER_BARRIER();
+  while (sstm_meta.start_ts != sstm_meta_global.seqlock)
+    {
+      sstm_meta.start_ts = sstm_norec_validate();
+      val = *addr;
+      COMPILER_BARRIER();
+    }
+
+  sstm_read_set_add(&sstm_meta.read_set, addr, val);
+  return val;
+}
+
+/* transactionally reads n words from src: every word is logged, then
+   the sequence lock is checked once for the whole range (a validation
+   covers the new entries too)
+*/
+void
+sstm_norec_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n)
+{
+  const int wrote = sstm_meta.write_set.log.n > 0;
+  size_t i;
+  for (i = 0; i < n; i++)
+    {
+      if (wrote)
+	{
+	  sstm_write_entry_t* w = sstm_write_set_find(&sstm_meta.write_set, src + i);
+	  if (w != NULL)
+	    {
+	      dst[i] = w->val;
+	      continue;
+	    }
+	}
+      uintptr_t val = src[i];
+      sstm_read_set_add(&sstm_meta.read_set, src + i, val);
+      dst[i] = val;
+    }
+
+  COMPILER_BARRIER();
+  if (sstm_meta.start_ts != sstm_meta_global.seqlock)
+    {
+      sstm_meta.start_ts = sstm_norec_validate();
+    }
+}
+
+/* transactionally writes val in addr: the write is buffered until commit
+*/
+inline void
+sstm_norec_tx_store(volatile uintptr_t* addr, uintptr_t val)
+{
+  int created;
+  sstm_write_entry_t* w = sstm_write_set_get(&sstm_meta.write_set, addr, &created);
+  if (!created)
+    {
+      sstm_nest_save(w);
+    }
+  w->val = val;
+}
+
+/* cleaning up in case of an abort
+   (e.g., flush the read or write logs)
+*/
+static void
+sstm_norec_tx_cleanup()
+{
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+  sstm_alloc_on_abort();
+  sstm_meta.n_aborts++;
+}
+
+/* closed nesting: forgets the reads and writes of the nested TX, and
+   revalidates the reads of its parents
+*/
+static int
+sstm_norec_tx_rollback(const sstm_nest_level_t* l, int reason)
+{
+  sstm_log_rewind(&sstm_meta.read_set, &l->read_set);
+  sstm_nest_write_set_rewind(l);
+  return sstm_norec_revalidate(&sstm_meta.start_ts);
+}
+
+/* tries to commit a transaction: update transactions acquire the
+   sequence lock at their (possibly extended) snapshot, write back,
+   and release it at the next even number
+ */
+static void
+sstm_norec_tx_commit()
+{
+  if (sstm_meta.write_set.log.n > 0)
+    {
+      while (!__sync_bool_compare_and_swap(&sstm_meta_global.seqlock,
+					   sstm_meta.start_ts, sstm_meta.start_ts + 1))
+	{
+	  sstm_meta.start_ts = sstm_norec_validate();
+	}
+
+      SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+	{
+	  *w->addr = w->val;
+	}
+      COMPILER_NO_REORDER(sstm_meta_global.seqlock = sstm_meta.start_ts + 2;);
+    }
+
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+  sstm_alloc_on_commit();
+  sstm_meta.n_commits++;
+}
+
+const sstm_algo_t sstm_algo_norec =
+  {
+    .name = "norec",
+    .read_only = 0,
+    .serial = 1,
+    .start = sstm_norec_start,
+    .stop = sstm_norec_stop,
+    .thread_start = sstm_norec_thread_start,
+    .thread_stop = sstm_norec_thread_stop,
+    .tx_start = sstm_norec_tx_start,
+    .tx_cleanup = sstm_norec_tx_cleanup,
+    .tx_commit = sstm_norec_tx_commit,
+    .tx_rollback = sstm_norec_tx_rollback,
+  };
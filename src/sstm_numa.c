@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "sstm_numa.h"
+
+/* topology from sysfs, thread placement, and NUMA-local memory (see
+ * sstm_numa.h)
+ */
+
+#define SSTM_SYSFS_CPU  "/sys/devices/system/cpu"
+#define SSTM_SYSFS_NODE "/sys/devices/system/node"
+
+typedef enum sstm_placement_id
+  {
+    SSTM_PLACEMENT_NONE,
+    SSTM_PLACEMENT_COMPACT,
+    SSTM_PLACEMENT_SCATTER,
+    SSTM_PLACEMENT_LIST,
+  } sstm_placement_id_t;
+
+static sstm_topology_t sstm_topo;
+static int sstm_node_of[SSTM_NUMA_MAX_CPUS];
+static pthread_once_t sstm_topo_once = PTHREAD_ONCE_INIT;
+
+static sstm_placement_id_t sstm_placement = SSTM_PLACEMENT_NONE;
+static int sstm_placement_order[SSTM_NUMA_MAX_CPUS];
+static size_t sstm_placement_n = 0;
+
+/* parses a CPU list ("0-3,8,10-11") into cpus; returns the number of
+   CPUs, or -1 if it is malformed
+*/
+static int
+sstm_cpulist_parse(const char* s, int* cpus, size_t max)
+{
+  size_t n = 0;
+  while (*s != '\0' && *s != '\n')
+    {
+      char* end;
+      long lo = strtol(s, &end, 10), hi = lo;
+      if (end == s || lo < 0)
+	{
+	  return -1;
+	}
+      s = end;
+      if (*s == '-')
+	{
+	  hi = strtol(s + 1, &end, 10);
+	  if (end == s + 1 || hi < lo)
+	    {
+	      return -1;
+	    }
+	  s = end;
+	}
+      for (; lo <= hi; lo++)
+	{
+	  if (n == max || lo >= SSTM_NUMA_MAX_CPUS)
+	    {
+	      return -1;
+	    }
+	  cpus[n++] = lo;
+	}
+      if (*s == ',')
+	{
+	  s++;
+	}
+      else if (*s != '\0' && *s != '\n')
+	{
+	  return -1;
+	}
+    }
+  return n;
+}
+
+/* the first line of a sysfs file, or 0 if it cannot be read */
+static int
+sstm_sysfs_read(const char* path, char* buf, size_t len)
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    {
+      return 0;
+    }
+  int ok = (fgets(buf, len, f) != NULL);
+  fclose(f);
+  return ok;
+}
+
+static int
+sstm_sysfs_int(const char* path, int def)
+{
+  char buf[64];
+  return sstm_sysfs_read(path, buf, sizeof(buf)) ? atoi(buf) : def;
+}
+
+static void
+sstm_topology_read()
+{
+  static int cpus[SSTM_NUMA_MAX_CPUS], node_cpus[SSTM_NUMA_MAX_CPUS];
+  char path[256], buf[4096];
+  int n = -1;
+  if (sstm_sysfs_read(SSTM_SYSFS_CPU "/online", buf, sizeof(buf)))
+    {
+      n = sstm_cpulist_parse(buf, cpus, SSTM_NUMA_MAX_CPUS);
+    }
+  if (n <= 0)
+    {
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+      n = (n <= 0) ? 1 : (n > SSTM_NUMA_MAX_CPUS ? SSTM_NUMA_MAX_CPUS : n);
+      int i;
+      for (i = 0; i < n; i++)
+	{
+	  cpus[i] = i;
+	}
+    }
+
+  memset(sstm_node_of, 0, sizeof(sstm_node_of));
+  int node, i;
+  for (node = 0; node < SSTM_NUMA_MAX_NODES; node++)
+    {
+      snprintf(path, sizeof(path), SSTM_SYSFS_NODE "/node%d/cpulist", node);
+      int ncpus;
+      if (sstm_sysfs_read(path, buf, sizeof(buf))
+	  && (ncpus = sstm_cpulist_parse(buf, node_cpus, SSTM_NUMA_MAX_CPUS)) > 0)
+	{
+	  for (i = 0; i < ncpus; i++)
+	    {
+	      sstm_node_of[node_cpus[i]] = node;
+	    }
+	}
+    }
+
+  sstm_topo.n_cpus = n;
+  for (i = 0; i < n; i++)
+    {
+      sstm_cpu_t* c = &sstm_topo.cpus[i];
+      c->cpu = cpus[i];
+      c->node = sstm_node_of[c->cpu];
+      snprintf(path, sizeof(path), SSTM_SYSFS_CPU "/cpu%d/topology/physical_package_id", c->cpu);
+      c->package = sstm_sysfs_int(path, 0);
+      snprintf(path, sizeof(path), SSTM_SYSFS_CPU "/cpu%d/topology/core_id", c->cpu);
+      c->core = sstm_sysfs_int(path, c->cpu);
+    }
+
+  /* distinct nodes, packages and cores */
+  sstm_topo.n_nodes = sstm_topo.n_packages = sstm_topo.n_cores = 0;
+  for (i = 0; i < n; i++)
+    {
+      const sstm_cpu_t* c = &sstm_topo.cpus[i];
+      int j, new_node = 1, new_package = 1, new_core = 1;
+      for (j = 0; j < i; j++)
+	{
+	  const sstm_cpu_t* d = &sstm_topo.cpus[j];
+	  new_node &= (d->node != c->node);
+	  new_package &= (d->package != c->package);
+	  new_core &= (d->package != c->package || d->core != c->core);
+	}
+      sstm_topo.n_nodes += new_node;
+      sstm_topo.n_packages += new_package;
+      sstm_topo.n_cores += new_core;
+    }
+}
+
+const sstm_topology_t*
+sstm_topology()
+{
+  pthread_once(&sstm_topo_once, sstm_topology_read);
+  return &sstm_topo;
+}
+
+int
+sstm_numa_node_of_cpu(int cpu)
+{
+  sstm_topology();
+  return (cpu >= 0 && cpu < SSTM_NUMA_MAX_CPUS) ? sstm_node_of[cpu] : -1;
+}
+
+int
+sstm_numa_thread_node()
+{
+  sstm_topology();
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+      return -1;
+    }
+  int node = -1, cpu;
+  for (cpu = 0; cpu < CPU_SETSIZE && cpu < SSTM_NUMA_MAX_CPUS; cpu++)
+    {
+      if (CPU_ISSET(cpu, &set))
+	{
+	  if (node >= 0 && sstm_node_of[cpu] != node)
+	    {
+	      return -1;
+	    }
+	  node = sstm_node_of[cpu];
+	}
+    }
+  return node;
+}
+
+int
+sstm_numa_bind(void* addr, size_t len, int node)
+{
+  if (node < 0 || node >= SSTM_NUMA_MAX_NODES || sstm_topology()->n_nodes <= 1)
+    {
+      return 0;
+    }
+
+  const size_t bits = 8 * sizeof(unsigned long);
+  unsigned long mask[SSTM_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+  mask[node / bits] |= 1UL << (node % bits);
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t) addr & ~(page - 1);
+  uintptr_t end = ((uintptr_t) addr + len + page - 1) & ~(page - 1);
+  return syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, mask, SSTM_NUMA_MAX_NODES + 1, MPOL_MF_MOVE)
+    == 0 ? 0 : -1;
+}
+
+void*
+sstm_numa_alloc(size_t size, int node)
+{
+  void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    {
+      perror("sstm: mmap");
+      exit(1);
+    }
+  sstm_numa_bind(mem, size, node);
+  return mem;
+}
+
+void
+sstm_numa_free(void* mem, size_t size)
+{
+  munmap(mem, size);
+}
+
+/* **************************************************************************************************** */
+/* placement */
+/* **************************************************************************************************** */
+
+/* compact: by node, then core, hyperthreads of a core together */
+static int
+sstm_cpu_cmp_compact(const void* a, const void* b)
+{
+  const sstm_cpu_t* x = &sstm_topo.cpus[*(const int*) a];
+  const sstm_cpu_t* y = &sstm_topo.cpus[*(const int*) b];
+  if (x->node != y->node)
+    return x->node - y->node;
+  if (x->package != y->package)
+    return x->package - y->package;
+  if (x->core != y->core)
+    return x->core - y->core;
+  return x->cpu - y->cpu;
+}
+
+/* scatter: the i-th CPU of every node, where the CPUs of a node are
+   ordered first hyperthreads first */
+static int sstm_scatter_rank[SSTM_NUMA_MAX_CPUS];
+
+static int
+sstm_cpu_cmp_scatter(const void* a, const void* b)
+{
+  int i = *(const int*) a, j = *(const int*) b;
+  if (sstm_scatter_rank[i] != sstm_scatter_rank[j])
+    return sstm_scatter_rank[i] - sstm_scatter_rank[j];
+  return sstm_topo.cpus[i].node - sstm_topo.cpus[j].node;
+}
+
+static void
+sstm_placement_scatter()
+{
+  const sstm_topology_t* t = &sstm_topo;
+  int smt[SSTM_NUMA_MAX_CPUS];
+  int i, j, n = t->n_cpus;
+  for (i = 0; i < n; i++)
+    {
+      smt[i] = 0;
+      for (j = 0; j < n; j++)
+	{
+	  smt[i] += (t->cpus[j].package == t->cpus[i].package && t->cpus[j].core == t->cpus[i].core
+		     && t->cpus[j].cpu < t->cpus[i].cpu);
+	}
+    }
+  /* rank in the node: by hyperthread, then compact order */
+  for (i = 0; i < n; i++)
+    {
+      sstm_scatter_rank[i] = 0;
+      for (j = 0; j < n; j++)
+	{
+	  int before = smt[j] < smt[i]
+	    || (smt[j] == smt[i] && sstm_cpu_cmp_compact(&j, &i) < 0);
+	  sstm_scatter_rank[i] += (t->cpus[j].node == t->cpus[i].node && before);
+	}
+    }
+  qsort(sstm_placement_order, sstm_placement_n, sizeof(int), sstm_cpu_cmp_scatter);
+}
+
+int
+sstm_placement_set(const char* spec)
+{
+  const sstm_topology_t* t = sstm_topology();
+  size_t i;
+  if (strcmp(spec, "none") == 0)
+    {
+      sstm_placement = SSTM_PLACEMENT_NONE;
+      sstm_placement_n = 0;
+      return 0;
+    }
+  if (strcmp(spec, "compact") == 0 || strcmp(spec, "scatter") == 0)
+    {
+      /* indices in sstm_topo.cpus, turned into CPU numbers below */
+      for (i = 0; i < t->n_cpus; i++)
+	{
+	  sstm_placement_order[i] = i;
+	}
+      sstm_placement_n = t->n_cpus;
+      if (spec[0] == 'c')
+	{
+	  sstm_placement = SSTM_PLACEMENT_COMPACT;
+	  qsort(sstm_placement_order, sstm_placement_n, sizeof(int), sstm_cpu_cmp_compact);
+	}
+      else
+	{
+	  sstm_placement = SSTM_PLACEMENT_SCATTER;
+	  sstm_placement_scatter();
+	}
+      for (i = 0; i < sstm_placement_n; i++)
+	{
+	  sstm_placement_order[i] = t->cpus[sstm_placement_order[i]].cpu;
+	}
+      return 0;
+    }
+
+  int n = sstm_cpulist_parse(spec, sstm_placement_order, SSTM_NUMA_MAX_CPUS);
+  if (n <= 0)
+    {
+      return -1;
+    }
+  sstm_placement = SSTM_PLACEMENT_LIST;
+  sstm_placement_n = n;
+  return 0;
+}
+
+const char*
+sstm_placement_name()
+{
+  static const char* names[] = { "none", "compact", "scatter", "CPU list" };
+  return names[sstm_placement];
+}
+
+int
+sstm_placement_cpu(size_t thread)
+{
+  if (sstm_placement == SSTM_PLACEMENT_NONE)
+    {
+      return -1;
+    }
+  return sstm_placement_order[thread % sstm_placement_n];
+}
+
+void
+sstm_placement_attr(pthread_attr_t* attr, size_t thread)
+{
+  int cpu = sstm_placement_cpu(thread);
+  if (cpu < 0)
+    {
+      return;
+    }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int rc = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+  if (rc != 0)
+    {
+      fprintf(stderr, "sstm: cannot pin thread %zu to CPU %d (%s)\n", thread, cpu, strerror(rc));
+    }
+}
+
+void
+sstm_print_placement(size_t n)
+{
+  const sstm_topology_t* t = sstm_topology();
+  printf("Topology       : %zu nodes, %zu packages, %zu cores, %zu CPUs\n",
+	 t->n_nodes, t->n_packages, t->n_cores, t->n_cpus);
+  printf("Placement      : %s\n", sstm_placement_name());
+  if (sstm_placement == SSTM_PLACEMENT_NONE)
+    {
+      return;
+    }
+  size_t i;
+  printf("Thread CPUs    :");
+  for (i = 0; i < n; i++)
+    {
+      printf(" %d", sstm_placement_cpu(i));
+    }
+  printf("\nThread nodes   :");
+  for (i = 0; i < n; i++)
+    {
+      printf(" %d", sstm_numa_node_of_cpu(sstm_placement_cpu(i)));
+    }
+  printf("\n");
+}
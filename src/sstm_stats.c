@@ -0,0 +1,346 @@
+#include <string.h>
+#include <time.h>
+
+#include "sstm.h"
+#include "random.h"
+
+/* detailed statistics: recorded per thread in sstm_meta.stats, and
+ * added to the global ones when the thread stops.
+ */
+
+static sstm_stats_t sstm_stats_global;
+static sstm_latency_t sstm_latency_global;
+static uint64_t sstm_stats_start_ticks;
+static struct timespec sstm_stats_start_time;
+
+static sstm_site_t* volatile sstm_sites = NULL; /* registered sites */
+static volatile size_t sstm_site_ids = 0;
+
+static const char* sstm_abort_reason_names[SSTM_ABORT_NUM] =
+  {
+    "none",
+    "explicit",
+    "read conflict",
+    "write-lock conflict",
+    "validation",
+    "read-only upgrade",
+    "serial (irrevocable)",
+    "lock timeout",
+    "capacity",
+    "snapshot too old",
+  };
+
+const char*
+sstm_abort_reason_name(int reason)
+{
+  if (reason <= 0 || reason >= SSTM_ABORT_NUM)
+    {
+      return "unknown";
+    }
+  return sstm_abort_reason_names[reason];
+}
+
+void
+sstm_stats_merge(const sstm_stats_t* stats)
+{
+  const size_t* src = (const size_t*) stats;
+  size_t* dst = (size_t*) &sstm_stats_global;
+  size_t i;
+  for (i = 0; i < sizeof(sstm_stats_t) / sizeof(size_t); i++)
+    {
+      if (src[i] != 0)
+	{
+	  __sync_fetch_and_add(&dst[i], src[i]);
+	}
+    }
+}
+
+void
+sstm_latency_merge(const sstm_latency_t* lat)
+{
+  size_t i;
+  for (i = 0; i < SSTM_LAT_BUCKETS; i++)
+    {
+      if (lat->hist[i] != 0)
+	{
+	  __sync_fetch_and_add(&sstm_latency_global.hist[i], lat->hist[i]);
+	}
+    }
+  __sync_fetch_and_add(&sstm_latency_global.n, lat->n);
+  __sync_fetch_and_add(&sstm_latency_global.sum, lat->sum);
+
+  size_t max;
+  while ((max = sstm_latency_global.max) < lat->max)
+    {
+      if (__sync_bool_compare_and_swap(&sstm_latency_global.max, max, lat->max))
+	{
+	  break;
+	}
+    }
+}
+
+void
+sstm_stats_reset()
+{
+  memset(&sstm_stats_global, 0, sizeof(sstm_stats_t));
+  memset(&sstm_latency_global, 0, sizeof(sstm_latency_t));
+  sstm_site_t* site;
+  for (site = sstm_sites; site != NULL; site = site->next)
+    {
+      memset(&site->stats, 0, sizeof(sstm_site_stats_t));
+    }
+  clock_gettime(CLOCK_MONOTONIC, &sstm_stats_start_time);
+  sstm_stats_start_ticks = getticks();
+}
+
+void
+sstm_site_register(sstm_site_t* site)
+{
+  size_t id = __sync_add_and_fetch(&sstm_site_ids, 1);
+  if (!__sync_bool_compare_and_swap(&site->id, 0, id))
+    {
+      return;			/* registered by another thread */
+    }
+
+  sstm_site_t* head;
+  do
+    {
+      head = sstm_sites;
+      site->next = head;
+    }
+  while (!__sync_bool_compare_and_swap(&sstm_sites, head, site));
+}
+
+/* per-thread counters are an array indexed by site id, grown on demand
+*/
+sstm_site_stats_t*
+sstm_site_stats_get(sstm_site_t* site)
+{
+  if (__builtin_expect(site->id == 0, 0))
+    {
+      sstm_site_register(site);
+    }
+
+  size_t id = site->id;
+  if (__builtin_expect(id >= sstm_meta.site_stats_size, 0))
+    {
+      size_t size = sstm_meta.site_stats_size ? 2 * sstm_meta.site_stats_size : 16;
+      while (size <= id)
+	{
+	  size <<= 1;
+	}
+      sstm_meta.site_stats = (sstm_site_stats_t*) realloc(sstm_meta.site_stats, size * sizeof(sstm_site_stats_t));
+      assert(sstm_meta.site_stats != NULL);
+      memset(sstm_meta.site_stats + sstm_meta.site_stats_size, 0,
+	     (size - sstm_meta.site_stats_size) * sizeof(sstm_site_stats_t));
+      sstm_meta.site_stats_size = size;
+    }
+  return &sstm_meta.site_stats[id];
+}
+
+/* adds the calling thread's per-site counters to the sites' totals
+*/
+void
+sstm_site_stats_merge()
+{
+  sstm_site_t* site;
+  for (site = sstm_sites; site != NULL; site = site->next)
+    {
+      if (site->id >= sstm_meta.site_stats_size)
+	{
+	  continue;
+	}
+      const size_t* src = (const size_t*) &sstm_meta.site_stats[site->id];
+      size_t* dst = (size_t*) &site->stats;
+      size_t i;
+      for (i = 0; i < sizeof(sstm_site_stats_t) / sizeof(size_t); i++)
+	{
+	  if (src[i] != 0)
+	    {
+	      __sync_fetch_and_add(&dst[i], src[i]);
+	    }
+	}
+    }
+
+  free(sstm_meta.site_stats);
+  sstm_meta.site_stats = NULL;
+  sstm_meta.site_stats_size = 0;
+}
+
+static int
+sstm_site_cmp(const void* a, const void* b)
+{
+  size_t ca = (*(sstm_site_t* const*) a)->stats.cycles;
+  size_t cb = (*(sstm_site_t* const*) b)->stats.cycles;
+  return (ca < cb) - (ca > cb);
+}
+
+void
+sstm_print_site_stats()
+{
+  size_t n = 0, total = 0;
+  sstm_site_t* site;
+  for (site = sstm_sites; site != NULL; site = site->next)
+    {
+      n++;
+      total += site->stats.cycles;
+    }
+  if (n == 0)
+    {
+      return;
+    }
+
+  sstm_site_t** sites = (sstm_site_t**) malloc(n * sizeof(sstm_site_t*));
+  assert(sites != NULL);
+  size_t i = 0;
+  for (site = sstm_sites; site != NULL; site = site->next)
+    {
+      sites[i++] = site;
+    }
+  qsort(sites, n, sizeof(sstm_site_t*), sstm_site_cmp);
+
+  printf("# %-4s %-7s %-10s %-10s %-7s %-11s %-8s %-8s %s\n", "Rank", "Cycles", "Commits", "Aborts",
+	 "Abort%", "Cyc/commit", "Rset", "Wset", "Site");
+  for (i = 0; i < n; i++)
+    {
+      const sstm_site_stats_t* st = &sites[i]->stats;
+      if (st->n_commits == 0 && st->n_aborts == 0)
+	{
+	  continue;
+	}
+      size_t c = st->n_commits ? st->n_commits : 1;
+      printf("# %-4zu %5.1f%%  %-10zu %-10zu %5.1f%%  %-11.0f %-8.2f %-8.2f %s:%d (%s)%s%s\n",
+	     i + 1, total ? 100.0 * st->cycles / total : 0.0, st->n_commits, st->n_aborts,
+	     100.0 * st->n_aborts / (st->n_commits + st->n_aborts), (double) st->cycles / c,
+	     (double) st->rset / c, (double) st->wset / c,
+	     sites[i]->file, sites[i]->line, sites[i]->func,
+	     sites[i]->label ? " " : "", sites[i]->label ? sites[i]->label : "");
+    }
+  free(sites);
+}
+
+const sstm_stats_t*
+sstm_thread_stats()
+{
+  return &sstm_meta.stats;
+}
+
+const sstm_stats_t*
+sstm_global_stats()
+{
+  return &sstm_stats_global;
+}
+
+const sstm_latency_t*
+sstm_thread_latency()
+{
+  return &sstm_meta.latency;
+}
+
+const sstm_latency_t*
+sstm_global_latency()
+{
+  return &sstm_latency_global;
+}
+
+uint64_t
+sstm_latency_percentile(const sstm_latency_t* lat, double p)
+{
+  if (lat->n == 0)
+    {
+      return 0;
+    }
+
+  size_t rank = (size_t) (p * lat->n);
+  size_t b, seen = 0;
+  for (b = 0; b < SSTM_LAT_BUCKETS; b++)
+    {
+      seen += lat->hist[b];
+      if (seen > rank)
+	{
+	  uint64_t v = sstm_latency_bucket_value(b);
+	  return v < lat->max ? v : lat->max;
+	}
+    }
+  return lat->max;
+}
+
+/* measured against CLOCK_MONOTONIC since sstm_start()
+*/
+double
+sstm_ticks_per_us()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t ticks = getticks() - sstm_stats_start_ticks;
+  double us = (now.tv_sec - sstm_stats_start_time.tv_sec) * 1e6
+    + (now.tv_nsec - sstm_stats_start_time.tv_nsec) / 1e3;
+  return us > 0 ? ticks / us : 0;
+}
+
+static void
+sstm_print_hist(const char* name, const size_t* hist, size_t sum, size_t n)
+{
+  printf("# %-16s: avg %.2f |", name, n ? (double) sum / n : 0.0);
+  size_t b;
+  for (b = 0; b < SSTM_STATS_BUCKETS; b++)
+    {
+      if (hist[b] == 0)
+	{
+	  continue;
+	}
+      if (b <= 1)
+	{
+	  printf(" %zu: %.1f%%", b, 100.0 * hist[b] / n);
+	}
+      else
+	{
+	  printf(" %zu-%zu: %.1f%%", 1UL << (b - 1), (1UL << b) - 1, 100.0 * hist[b] / n);
+	}
+    }
+  printf("\n");
+}
+
+/* prints the global statistics (all threads must have stopped)
+*/
+void
+sstm_print_detailed_stats(double dur_s)
+{
+  const sstm_stats_t* s = &sstm_stats_global;
+  size_t n_update = s->n_commits - s->n_commits_ro - s->n_commits_serial;
+
+  printf("# Commits          : %-10zu - %.0f /s (update %zu, read-only %zu, serial %zu)\n",
+	 s->n_commits, s->n_commits / dur_s, n_update, s->n_commits_ro, s->n_commits_serial);
+  printf("# Aborts           : %-10zu - %.0f /s\n", s->n_aborts, s->n_aborts / dur_s);
+  int r;
+  for (r = 1; r < SSTM_ABORT_NUM; r++)
+    {
+      if (s->aborts[r] != 0)
+	{
+	  printf("#   %-20s: %-10zu (%.1f%%)\n", sstm_abort_reason_name(r), s->aborts[r],
+		 100.0 * s->aborts[r] / s->n_aborts);
+	}
+    }
+  if (s->n_aborts_nested != 0)
+    {
+      printf("#   %-20s: %-10zu (%.1f%%)\n", "nested TX only", s->n_aborts_nested,
+	     100.0 * s->n_aborts_nested / s->n_aborts);
+    }
+  sstm_print_hist("Retries / commit", s->retries_hist, s->retries, s->n_commits);
+  sstm_print_hist("Read set", s->rset_hist, s->rset, n_update);
+  sstm_print_hist("Write set", s->wset_hist, s->wset, n_update);
+
+  const sstm_latency_t* l = &sstm_latency_global;
+  double tpu = sstm_ticks_per_us();
+  if (l->n > 0 && tpu > 0)
+    {
+      printf("# Latency (cycles) : avg %.0f | p50 %zu | p99 %zu | p99.9 %zu | max %zu\n",
+	     (double) l->sum / l->n,
+	     sstm_latency_percentile(l, 0.5), sstm_latency_percentile(l, 0.99),
+	     sstm_latency_percentile(l, 0.999), l->max);
+      printf("# Latency (us)     : avg %.2f | p50 %.2f | p99 %.2f | p99.9 %.2f | max %.2f\n",
+	     (double) l->sum / l->n / tpu,
+	     sstm_latency_percentile(l, 0.5) / tpu, sstm_latency_percentile(l, 0.99) / tpu,
+	     sstm_latency_percentile(l, 0.999) / tpu, l->max / tpu);
+    }
+}
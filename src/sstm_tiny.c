@@ -0,0 +1,381 @@
+#include "sstm.h"
+#include "sstm_clock.h"
+#include "sstm_cm.h"
+#include "sstm_validate.h"
+
+/* TinySTM/LSA (write-through): orecs are locked on the first store to
+ * a stripe (encounter-time locking) and memory is updated in place,
+ * with the old values kept in an undo log that is replayed on abort.
+ * Reads that see a version newer than the snapshot try to extend the
+ * snapshot to the current clock (by validating the read set) instead
+ * of aborting.
+ */
+
+static void
+sstm_tiny_start()
+{
+  sstm_orecs_create();
+}
+
+static void
+sstm_tiny_stop()
+{
+  sstm_orecs_destroy();
+}
+
+static void
+sstm_tiny_thread_start()
+{
+  sstm_read_set_init(&sstm_meta.read_set);
+  sstm_undo_log_init(&sstm_meta.undo_log);
+}
+
+static void
+sstm_tiny_thread_stop()
+{
+  sstm_read_set_destroy(&sstm_meta.read_set);
+  sstm_undo_log_destroy(&sstm_meta.undo_log);
+}
+
+/* takes a snapshot of the global clock
+*/
+static void
+sstm_tiny_tx_start()
+{
+  sstm_meta.start_ts = sstm_clock_read();
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_log_clear(&sstm_meta.undo_log);
+}
+
+/* every orec in the read set must still have the version we observed,
+   and must not be locked by another transaction
+*/
+static inline int
+sstm_tiny_validate()
+{
+  return sstm_validate_orecs(sstm_meta_global.validate, &sstm_meta.read_set, sstm_meta.id);
+}
+
+/* extends the snapshot to the current clock, if the read set is
+   still valid at that time
+*/
+static inline int
+sstm_tiny_extend()
+{
+  size_t now = sstm_clock_read();
+  COMPILER_BARRIER();
+  if (sstm_tiny_validate())
+    {
+      sstm_meta.start_ts = now;
+      return 1;
+    }
+  return 0;
+}
+
+/* transactionally reads the value of addr:
+ * stripes that we have locked are read in place; otherwise the orec
+ * must be unlocked and unchanged around the read, and its version
+ * must be covered by the (possibly extended) snapshot. Read-only
+ * transactions do not log their reads, so they cannot extend.
+*/
+inline uintptr_t
+sstm_tiny_tx_load(volatile uintptr_t* addr)
+{
+  sstm_orec_t* orec = sstm_orec_get(&sstm_meta_global.orecs, addr);
+  uintptr_t o, val;
+
+  while (1)
+    {
+      o = *orec;
+      if (OREC_IS_LOCKED(o))
+	{
+	  if (OREC_OWNER(o) == sstm_meta.id)
+	    {
+	      return *addr;
+	    }
+	  if (sstm_cm_conflict(orec, o))
+	    {
+	      continue;
+	    }
+	  sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	}
+
+      COMPILER_BARRIER();
+      val = *addr;
+      COMPILER_BARRIER();
+      if (o != *orec)
+	{
+	  continue;
+	}
+
+      if (OREC_VERSION(o) > sstm_meta.start_ts)
+	{
+	  sstm_clock_observe(OREC_VERSION(o));
+	  if (sstm_meta.ro)
+	    {
+	      /* no read set to extend the snapshot with:
+		 retry in update mode, which logs reads */
+	      sstm_meta.ro_disable = 1;
+	      sstm_tx_abort(SSTM_ABORT_VALIDATION);
+	    }
+	  if (!sstm_tiny_extend())
+	    {
+	      sstm_tx_abort(SSTM_ABORT_VALIDATION);
+	    }
+	  continue;
+	}
+      break;
+    }
+
+  if (sstm_meta.ro)
+    {
+      return val;
+    }
+
+  sstm_read_set_add(&sstm_meta.read_set, orec, o);
+  return val;
+}
+
+/* transactionally reads n words from src, checking (and logging) every
+   stripe once, like a single word
+*/
+void
+sstm_tiny_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n)
+{
+  const sstm_orec_table_t* t = &sstm_meta_global.orecs;
+  volatile uintptr_t* end = src + n;
+  while (src < end)
+    {
+      size_t k = sstm_orec_stripe_words(t, src, end);
+      sstm_orec_t* orec = sstm_orec_get(t, src);
+      uintptr_t o;
+      size_t i;
+      while (1)
+	{
+	  o = *orec;
+	  if (OREC_IS_LOCKED(o))
+	    {
+	      if (OREC_OWNER(o) == sstm_meta.id)
+		{
+		  break;
+		}
+	      if (sstm_cm_conflict(orec, o))
+		{
+		  continue;
+		}
+	      sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	    }
+
+	  COMPILER_BARRIER();
+	  for (i = 0; i < k; i++)
+	    {
+	      dst[i] = src[i];
+	    }
+	  COMPILER_BARRIER();
+	  if (o != *orec)
+	    {
+	      continue;
+	    }
+
+	  if (OREC_VERSION(o) > sstm_meta.start_ts)
+	    {
+	      sstm_clock_observe(OREC_VERSION(o));
+	      if (sstm_meta.ro)
+		{
+		  sstm_meta.ro_disable = 1;
+		  sstm_tx_abort(SSTM_ABORT_VALIDATION);
+		}
+	      if (!sstm_tiny_extend())
+		{
+		  sstm_tx_abort(SSTM_ABORT_VALIDATION);
+		}
+	      continue;
+	    }
+	  break;
+	}
+
+      if (OREC_IS_LOCKED(o))
+	{
+	  /* our stripe: read in place */
+	  for (i = 0; i < k; i++)
+	    {
+	      dst[i] = src[i];
+	    }
+	}
+      else if (!sstm_meta.ro)
+	{
+	  sstm_read_set_add(&sstm_meta.read_set, orec, o);
+	}
+      dst += k;
+      src += k;
+    }
+}
+
+/* transactionally writes val in addr: locks the stripe (if not
+   already ours), logs the old value, and writes in place
+*/
+inline void
+sstm_tiny_tx_store(volatile uintptr_t* addr, uintptr_t val)
+{
+  const size_t id = sstm_meta.id;
+  sstm_orec_t* orec = sstm_orec_get(&sstm_meta_global.orecs, addr);
+  size_t acquired = 0;
+
+  while (1)
+    {
+      uintptr_t o = *orec;
+      if (OREC_IS_LOCKED(o))
+	{
+	  if (OREC_OWNER(o) == id)
+	    {
+	      break;
+	    }
+	  if (sstm_cm_conflict(orec, o))
+	    {
+	      continue;
+	    }
+	  sstm_tx_abort(SSTM_ABORT_WW_CONFLICT);
+	}
+
+      if (OREC_VERSION(o) > sstm_meta.start_ts)
+	{
+	  sstm_clock_observe(OREC_VERSION(o));
+	  if (!sstm_tiny_extend())
+	    {
+	      sstm_tx_abort(SSTM_ABORT_VALIDATION);
+	    }
+	  continue;
+	}
+
+      if (__sync_bool_compare_and_swap(orec, o, OREC_LOCKED_BY(o, id)))
+	{
+	  acquired = 1;
+	  break;
+	}
+    }
+
+  sstm_write_entry_t* u = sstm_undo_log_add(&sstm_meta.undo_log);
+  u->addr = addr;
+  u->val = *addr;
+  u->orec = orec;
+  u->locked = acquired;
+  *addr = val;
+}
+
+/* cleaning up in case of an abort: restores the old values in reverse
+   order, then releases our orecs with a fresh version, so that readers
+   that saw our in-place writes cannot validate against the old one
+*/
+static void
+sstm_tiny_tx_cleanup()
+{
+  if (sstm_meta.undo_log.n > 0)
+    {
+      SSTM_LOG_FOREACH_REVERSE(&sstm_meta.undo_log, sstm_write_entry_t, u)
+	{
+	  *u->addr = u->val;
+	}
+      COMPILER_BARRIER();
+
+      int validate;
+      size_t ts = sstm_clock_commit(sstm_meta.start_ts, &validate);
+      SSTM_LOG_FOREACH_REVERSE(&sstm_meta.undo_log, sstm_write_entry_t, u)
+	{
+	  if (u->locked)
+	    {
+	      /* with deferred or shared timestamps, ts might not be newer */
+	      size_t v = OREC_VERSION(*u->orec);
+	      *u->orec = OREC_MAKE(v >= ts ? v + 1 : ts);
+	    }
+	}
+    }
+
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_log_clear(&sstm_meta.undo_log);
+  sstm_alloc_on_abort();
+  sstm_meta.n_aborts++;
+}
+
+/* closed nesting: undoes the writes of the nested TX and releases the
+   orecs it acquired (with a fresh version, as on abort), forgets its
+   reads, then extends the snapshot if the reads of its parents are
+   still valid. A lock conflict while the parents hold orecs can be a
+   cycle of TXs waiting for each other, that only releasing them breaks
+*/
+static int
+sstm_tiny_tx_rollback(const sstm_nest_level_t* l, int reason)
+{
+  if (sstm_meta.undo_log.n > l->undo_log.n)
+    {
+      SSTM_LOG_FOREACH_REVERSE_SINCE(&sstm_meta.undo_log, &l->undo_log, sstm_write_entry_t, u)
+	{
+	  *u->addr = u->val;
+	}
+      COMPILER_BARRIER();
+
+      int validate;
+      size_t ts = sstm_clock_commit(sstm_meta.start_ts, &validate);
+      SSTM_LOG_FOREACH_REVERSE_SINCE(&sstm_meta.undo_log, &l->undo_log, sstm_write_entry_t, u)
+	{
+	  if (u->locked)
+	    {
+	      size_t v = OREC_VERSION(*u->orec);
+	      *u->orec = OREC_MAKE(v >= ts ? v + 1 : ts);
+	    }
+	}
+      sstm_log_rewind(&sstm_meta.undo_log, &l->undo_log);
+    }
+
+  sstm_log_rewind(&sstm_meta.read_set, &l->read_set);
+  if (reason != SSTM_ABORT_VALIDATION && l->undo_log.n > 0)
+    {
+      return 0;
+    }
+  return sstm_tiny_extend();
+}
+
+/* tries to commit a transaction: update transactions increment the
+   global clock, validate their read set if other transactions
+   committed since their snapshot, and release their orecs
+ */
+static void
+sstm_tiny_tx_commit()
+{
+  if (sstm_meta.undo_log.n > 0)
+    {
+      int validate;
+      size_t commit_ts = sstm_clock_commit(sstm_meta.start_ts, &validate);
+      if (validate && !sstm_tiny_validate())
+	{
+	  sstm_tx_abort(SSTM_ABORT_VALIDATION);
+	}
+
+      SSTM_LOG_FOREACH(&sstm_meta.undo_log, sstm_write_entry_t, u)
+	{
+	  if (u->locked)
+	    {
+	      *u->orec = OREC_MAKE(commit_ts);
+	    }
+	}
+    }
+
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_log_clear(&sstm_meta.undo_log);
+  sstm_alloc_on_commit();
+  sstm_meta.n_commits++;
+}
+
+const sstm_algo_t sstm_algo_tiny =
+  {
+    .name = "tiny",
+    .read_only = 1,
+    .serial = 1,
+    .start = sstm_tiny_start,
+    .stop = sstm_tiny_stop,
+    .thread_start = sstm_tiny_thread_start,
+    .thread_stop = sstm_tiny_thread_stop,
+    .tx_start = sstm_tiny_tx_start,
+    .tx_cleanup = sstm_tiny_tx_cleanup,
+    .tx_commit = sstm_tiny_tx_commit,
+    .tx_rollback = sstm_tiny_tx_rollback,
+  };
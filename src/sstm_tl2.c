@@ -0,0 +1,331 @@
+#include "sstm.h"
+#include "sstm_clock.h"
+#include "sstm_cm.h"
+#include "sstm_validate.h"
+
+/* TL2: a global version clock plus a table of versioned write locks
+ * (orecs). Reads are invisible and are checked against the snapshot
+ * taken at TX start; writes are buffered in the write set and made
+ * visible at commit, after acquiring the orecs of the written
+ * locations and validating the read set.
+ */
+
+static void
+sstm_tl2_start()
+{
+  sstm_orecs_create();
+}
+
+static void
+sstm_tl2_stop()
+{
+  sstm_orecs_destroy();
+}
+
+static void
+sstm_tl2_thread_start()
+{
+  sstm_read_set_init(&sstm_meta.read_set);
+  sstm_write_set_init(&sstm_meta.write_set);
+}
+
+static void
+sstm_tl2_thread_stop()
+{
+  sstm_read_set_destroy(&sstm_meta.read_set);
+  sstm_write_set_destroy(&sstm_meta.write_set);
+}
+
+/* takes a snapshot of the global clock
+*/
+static void
+sstm_tl2_tx_start()
+{
+  sstm_meta.start_ts = sstm_clock_read();
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+}
+
+/* transactionally reads the value of addr:
+ * read-after-write returns the buffered value, otherwise the orec
+ * must be unlocked and not newer than the snapshot, both before and
+ * after reading the value. Read-only transactions do not log their
+ * reads: they are consistent with the snapshot, which is all TL2
+ * validates at commit.
+*/
+inline uintptr_t
+sstm_tl2_tx_load(volatile uintptr_t* addr)
+{
+  if (sstm_meta.write_set.log.n > 0)
+    {
+      sstm_write_entry_t* w = sstm_write_set_find(&sstm_meta.write_set, addr);
+      if (w != NULL)
+	{
+	  return w->val;
+	}
+    }
+
+  sstm_orec_t* orec = sstm_orec_get(&sstm_meta_global.orecs, addr);
+  uintptr_t o, val;
+  while (1)
+    {
+      o = *orec;
+      COMPILER_BARRIER();
+      val = *addr;
+      COMPILER_BARRIER();
+
+      if (OREC_IS_LOCKED(o))
+	{
+	  if (sstm_cm_conflict(orec, o))
+	    {
+	      continue;
+	    }
+	  sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	}
+      if (o != *orec)
+	{
+	  sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	}
+      break;
+    }
+  if (OREC_VERSION(o) > sstm_meta.start_ts)
+    {
+      sstm_clock_observe(OREC_VERSION(o));
+      sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+    }
+
+  if (sstm_meta.ro)
+    {
+      return val;
+    }
+
+  sstm_read_set_add(&sstm_meta.read_set, orec, o);
+  return val;
+}
+
+/* transactionally reads n words from src: every stripe is copied and
+   checked (and logged) once, like a single word, then the words we
+   wrote are replaced by their buffered values
+*/
+void
+sstm_tl2_tx_load_range(uintptr_t* dst, volatile uintptr_t* src, size_t n)
+{
+  /* locals survive the compiler barriers */
+  const sstm_orec_table_t t = sstm_meta_global.orecs;
+  const size_t start_ts = sstm_meta.start_ts;
+  const int ro = sstm_meta.ro;
+  const int wrote = sstm_meta.write_set.log.n > 0;
+  volatile uintptr_t* end = src + n;
+  while (src < end)
+    {
+      size_t k = sstm_orec_stripe_words(&t, src, end);
+      sstm_orec_t* orec = sstm_orec_get(&t, src);
+      uintptr_t o;
+      size_t i;
+      while (1)
+	{
+	  o = *orec;
+	  COMPILER_BARRIER();
+	  for (i = 0; i < k; i++)
+	    {
+	      dst[i] = src[i];
+	    }
+	  COMPILER_BARRIER();
+
+	  if (__builtin_expect(OREC_IS_LOCKED(o), 0))
+	    {
+	      if (sstm_cm_conflict(orec, o))
+		{
+		  continue;
+		}
+	      sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	    }
+	  if (__builtin_expect(o != *orec, 0))
+	    {
+	      sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	    }
+	  break;
+	}
+      if (__builtin_expect(OREC_VERSION(o) > start_ts, 0))
+	{
+	  sstm_clock_observe(OREC_VERSION(o));
+	  sstm_tx_abort(SSTM_ABORT_RW_CONFLICT);
+	}
+
+      if (!ro)
+	{
+	  sstm_read_set_add(&sstm_meta.read_set, orec, o);
+	}
+      if (wrote)
+	{
+	  for (i = 0; i < k; i++)
+	    {
+	      sstm_write_entry_t* w = sstm_write_set_find(&sstm_meta.write_set, src + i);
+	      if (w != NULL)
+		{
+		  dst[i] = w->val;
+		}
+	    }
+	}
+      dst += k;
+      src += k;
+    }
+}
+
+/* transactionally writes val in addr: the write is buffered until commit
+*/
+inline void
+sstm_tl2_tx_store(volatile uintptr_t* addr, uintptr_t val)
+{
+  int created;
+  sstm_write_entry_t* w = sstm_write_set_get(&sstm_meta.write_set, addr, &created);
+  if (created)
+    {
+      w->orec = sstm_orec_get(&sstm_meta_global.orecs, addr);
+      w->locked = 0;
+    }
+  else
+    {
+      sstm_nest_save(w);
+    }
+  w->val = val;
+}
+
+/* releases the orecs acquired during an unsuccessful commit,
+   restoring the version they had before
+*/
+static inline void
+sstm_tl2_unlock_write_set()
+{
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      if (w->locked)
+	{
+	  *w->orec = OREC_UNLOCKED(*w->orec);
+	  w->locked = 0;
+	}
+    }
+}
+
+/* cleaning up in case of an abort
+   (e.g., flush the read or write logs)
+*/
+static void
+sstm_tl2_tx_cleanup()
+{
+  sstm_tl2_unlock_write_set();
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+  sstm_alloc_on_abort();
+  sstm_meta.n_aborts++;
+}
+
+/* every orec in the read set must still be unlocked (or locked by us)
+   and not newer than the snapshot
+*/
+static inline int
+sstm_tl2_validate()
+{
+  return sstm_validate_versions(sstm_meta_global.validate, &sstm_meta.read_set,
+				sstm_meta.id, sstm_meta.start_ts);
+}
+
+/* closed nesting: forgets the reads and writes of the nested TX, and
+   extends the snapshot to the current clock if the reads of its
+   parents have not changed since the snapshot (mvcc uses it too)
+*/
+int
+sstm_tl2_tx_rollback(const sstm_nest_level_t* l, int reason)
+{
+  sstm_log_rewind(&sstm_meta.read_set, &l->read_set);
+  sstm_nest_write_set_rewind(l);
+
+  size_t now = sstm_clock_read();
+  COMPILER_BARRIER();
+  if (!sstm_tl2_validate())
+    {
+      return 0;
+    }
+  sstm_meta.start_ts = now;
+  return 1;
+}
+
+/* tries to commit a transaction: read-only transactions are already
+   consistent; update transactions lock their write set, increment the
+   global clock, validate their read set, and write back
+ */
+static void
+sstm_tl2_tx_commit()
+{
+  if (sstm_meta.write_set.log.n == 0)
+    {
+      sstm_log_clear(&sstm_meta.read_set);
+      sstm_alloc_on_commit();
+      sstm_meta.n_commits++;
+      return;
+    }
+
+  const size_t id = sstm_meta.id;
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      uintptr_t o = *w->orec;
+      while (OREC_IS_LOCKED(o) && OREC_OWNER(o) != id)
+	{
+	  if (!sstm_cm_conflict(w->orec, o))
+	    {
+	      sstm_tx_abort(SSTM_ABORT_WW_CONFLICT);
+	    }
+	  o = *w->orec;
+	}
+      if (OREC_IS_LOCKED(o))
+	{
+	  continue;		/* another address on the same stripe */
+	}
+      if (!__sync_bool_compare_and_swap(w->orec, o, OREC_LOCKED_BY(o, id)))
+	{
+	  sstm_tx_abort(SSTM_ABORT_WW_CONFLICT);
+	}
+      w->locked = 1;
+    }
+
+  int validate;
+  size_t commit_ts = sstm_clock_commit(sstm_meta.start_ts, &validate);
+  if (validate && !sstm_tl2_validate())
+    {
+      sstm_tx_abort(SSTM_ABORT_VALIDATION);
+    }
+
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      *w->addr = w->val;
+    }
+  COMPILER_BARRIER();
+  SSTM_LOG_FOREACH(&sstm_meta.write_set.log, sstm_write_entry_t, w)
+    {
+      if (w->locked)
+	{
+	  *w->orec = OREC_MAKE(commit_ts);
+	  w->locked = 0;
+	}
+    }
+
+  sstm_log_clear(&sstm_meta.read_set);
+  sstm_write_set_clear(&sstm_meta.write_set);
+  sstm_alloc_on_commit();
+  sstm_meta.n_commits++;
+}
+
+const sstm_algo_t sstm_algo_tl2 =
+  {
+    .name = "tl2",
+    .read_only = 1,
+    .serial = 1,
+    .start = sstm_tl2_start,
+    .stop = sstm_tl2_stop,
+    .thread_start = sstm_tl2_thread_start,
+    .thread_stop = sstm_tl2_thread_stop,
+    .tx_start = sstm_tl2_tx_start,
+    .tx_cleanup = sstm_tl2_tx_cleanup,
+    .tx_commit = sstm_tl2_tx_commit,
+    .tx_rollback = sstm_tl2_tx_rollback,
+  };
@@ -0,0 +1,207 @@
+#include "sstm.h"
+#include "sstm_validate.h"
+
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#endif
+
+/* read-set validation kernels. The vector ones check whole groups of
+ * 4 entries and leave the rest of the chunk to the scalar ones.
+ */
+
+/* scalar
+*/
+static int
+sstm_validate_scalar_supported()
+{
+  return 1;
+}
+
+static int
+sstm_validate_scalar_versions(volatile uintptr_t* const* words, size_t n, size_t id, size_t ts)
+{
+  size_t i;
+  for (i = 0; i < n; i++)
+    {
+      uintptr_t o = *words[i];
+      if ((OREC_IS_LOCKED(o) && OREC_OWNER(o) != id) || OREC_VERSION(o) > ts)
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+static int
+sstm_validate_scalar_orecs(volatile uintptr_t* const* words, const uintptr_t* vals, size_t n, size_t id)
+{
+  size_t i;
+  for (i = 0; i < n; i++)
+    {
+      uintptr_t o = *words[i];
+      if (OREC_UNLOCKED(o) != vals[i] || (OREC_IS_LOCKED(o) && OREC_OWNER(o) != id))
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+static int
+sstm_validate_scalar_values(volatile uintptr_t* const* words, const uintptr_t* vals, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++)
+    {
+      if (*words[i] != vals[i])
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+static const sstm_validate_t sstm_validate_scalar =
+  {
+    .name = "scalar",
+    .supported = sstm_validate_scalar_supported,
+    .versions = sstm_validate_scalar_versions,
+    .orecs = sstm_validate_scalar_orecs,
+    .values = sstm_validate_scalar_values,
+  };
+
+/* avx2: compiled for AVX2 whatever the flags of the build, and only
+   used if CPUID reports it. A gather with a NULL base and a scale of 1
+   loads the words at the 4 addresses of the index vector. Versions
+   are below 2^47, so the signed 64-bit compares are safe
+*/
+#if defined(__x86_64__)
+
+#define SSTM_AVX2 __attribute__ ((target("avx2")))
+
+static int
+sstm_validate_avx2_supported()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+SSTM_AVX2 static inline __m256i
+sstm_validate_avx2_gather(volatile uintptr_t* const* words)
+{
+  __m256i a = _mm256_load_si256((const __m256i*) words);
+  return _mm256_i64gather_epi64((const long long*) 0, a, 1);
+}
+
+/* the lanes locked by another TX than the one whose (locked) orecs
+   look like mine */
+SSTM_AVX2 static inline __m256i
+sstm_validate_avx2_foreign(__m256i o, __m256i lock, __m256i owner_mask, __m256i mine)
+{
+  __m256i locked = _mm256_cmpeq_epi64(_mm256_and_si256(o, lock), lock);
+  __m256i ours = _mm256_cmpeq_epi64(_mm256_and_si256(o, owner_mask), mine);
+  return _mm256_andnot_si256(ours, locked);
+}
+
+SSTM_AVX2 static int
+sstm_validate_avx2_versions(volatile uintptr_t* const* words, size_t n, size_t id, size_t ts)
+{
+  const __m256i lock = _mm256_set1_epi64x(OREC_LOCK_BIT);
+  const __m256i version_bits = _mm256_set1_epi64x(OREC_VERSION_BITS);
+  const __m256i owner_mask = _mm256_set1_epi64x(~OREC_VERSION_BITS);
+  const __m256i mine = _mm256_set1_epi64x(OREC_LOCKED_BY(0, id));
+  const __m256i max = _mm256_set1_epi64x(OREC_MAKE(ts));
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m256i o = sstm_validate_avx2_gather(words + i);
+      __m256i newer = _mm256_cmpgt_epi64(_mm256_and_si256(o, version_bits), max);
+      __m256i bad = _mm256_or_si256(newer, sstm_validate_avx2_foreign(o, lock, owner_mask, mine));
+      if (!_mm256_testz_si256(bad, bad))
+	{
+	  return 0;
+	}
+    }
+  return sstm_validate_scalar_versions(words + i, n - i, id, ts);
+}
+
+SSTM_AVX2 static int
+sstm_validate_avx2_orecs(volatile uintptr_t* const* words, const uintptr_t* vals, size_t n, size_t id)
+{
+  const __m256i lock = _mm256_set1_epi64x(OREC_LOCK_BIT);
+  const __m256i version_bits = _mm256_set1_epi64x(OREC_VERSION_BITS);
+  const __m256i owner_mask = _mm256_set1_epi64x(~OREC_VERSION_BITS);
+  const __m256i mine = _mm256_set1_epi64x(OREC_LOCKED_BY(0, id));
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m256i o = sstm_validate_avx2_gather(words + i);
+      __m256i v = _mm256_load_si256((const __m256i*) (vals + i));
+      __m256i same = _mm256_cmpeq_epi64(_mm256_and_si256(o, version_bits), v);
+      __m256i bad = _mm256_andnot_si256(same, _mm256_set1_epi64x(-1));
+      bad = _mm256_or_si256(bad, sstm_validate_avx2_foreign(o, lock, owner_mask, mine));
+      if (!_mm256_testz_si256(bad, bad))
+	{
+	  return 0;
+	}
+    }
+  return sstm_validate_scalar_orecs(words + i, vals + i, n - i, id);
+}
+
+SSTM_AVX2 static int
+sstm_validate_avx2_values(volatile uintptr_t* const* words, const uintptr_t* vals, size_t n)
+{
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m256i o = sstm_validate_avx2_gather(words + i);
+      __m256i v = _mm256_load_si256((const __m256i*) (vals + i));
+      if (!_mm256_testc_si256(_mm256_cmpeq_epi64(o, v), ones))
+	{
+	  return 0;
+	}
+    }
+  return sstm_validate_scalar_values(words + i, vals + i, n - i);
+}
+
+static const sstm_validate_t sstm_validate_avx2 =
+  {
+    .name = "avx2",
+    .supported = sstm_validate_avx2_supported,
+    .versions = sstm_validate_avx2_versions,
+    .orecs = sstm_validate_avx2_orecs,
+    .values = sstm_validate_avx2_values,
+  };
+
+#else  /* !__x86_64__ */
+
+static int
+sstm_validate_avx2_supported()
+{
+  return 0;
+}
+
+static const sstm_validate_t sstm_validate_avx2 =
+  {
+    .name = "avx2",
+    .supported = sstm_validate_avx2_supported,
+    .versions = sstm_validate_scalar_versions,
+    .orecs = sstm_validate_scalar_orecs,
+    .values = sstm_validate_scalar_values,
+  };
+
+#endif	/* __x86_64__ */
+
+/* indexed by sstm_validate_id_t */
+const sstm_validate_t* sstm_validates[SSTM_VALIDATE_NUM] =
+  {
+    &sstm_validate_scalar,
+    &sstm_validate_avx2,
+  };
+
+sstm_validate_id_t
+sstm_validate_default()
+{
+  return sstm_validate_avx2.supported() ? SSTM_VALIDATE_AVX2 : SSTM_VALIDATE_SCALAR;
+}
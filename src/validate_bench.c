@@ -0,0 +1,232 @@
+#include <assert.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "sstm.h"
+#include "sstm_validate.h"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * Read-set validation throughput: fills the read set of the calling
+ * thread with n entries and validates it over and over with every
+ * kernel the CPU supports, for the three checks (versions: tl2, orecs:
+ * tiny, values: norec) and read-set sizes from -s to -m.
+ */
+
+#define DEFAULT_MIN_SIZE                16
+#define DEFAULT_MAX_SIZE                65536
+#define DEFAULT_ENTRIES                 (1UL << 24) /* validated per measurement */
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+typedef enum check
+  {
+    CHECK_VERSIONS,
+    CHECK_ORECS,
+    CHECK_VALUES,
+    CHECK_NUM
+  } check_t;
+
+static const char* check_names[CHECK_NUM] = { "versions", "orecs", "values" };
+
+static double
+now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* logs words[0..n) in the read set as check expects them */
+static void
+fill(check_t check, uintptr_t** words, size_t n)
+{
+  sstm_log_clear(&sstm_meta.read_set);
+  size_t i;
+  for (i = 0; i < n; i++)
+    {
+      if (check == CHECK_VALUES)
+	{
+	  sstm_read_set_add(&sstm_meta.read_set, words[i], *words[i]);
+	}
+      else
+	{
+	  sstm_orec_t* orec = sstm_orec_get(&sstm_meta_global.orecs, words[i]);
+	  sstm_read_set_add(&sstm_meta.read_set, orec, OREC_UNLOCKED(*orec));
+	}
+    }
+}
+
+/* millions of entries validated per second */
+static double
+measure(const sstm_validate_t* v, check_t check, size_t n)
+{
+  size_t reps = DEFAULT_ENTRIES / n, r;
+  int ok = 1;
+  double start = now();
+  for (r = 0; r < reps; r++)
+    {
+      switch (check)
+	{
+	case CHECK_VERSIONS:
+	  ok &= sstm_validate_versions(v, &sstm_meta.read_set, sstm_meta.id, sstm_meta_global.clock);
+	  break;
+	case CHECK_ORECS:
+	  ok &= sstm_validate_orecs(v, &sstm_meta.read_set, sstm_meta.id);
+	  break;
+	default:
+	  ok &= sstm_validate_values(v, &sstm_meta.read_set);
+	  break;
+	}
+    }
+  double elapsed = now() - start;
+  assert(ok);
+  return reps * n / elapsed / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help", no_argument, NULL, 'h'},
+      {"min-size", required_argument, NULL, 's'},
+      {"max-size", required_argument, NULL, 'm'},
+      {"random", no_argument, NULL, 'r'},
+      {NULL, 0, NULL, 0}
+    };
+
+  size_t min_size = DEFAULT_MIN_SIZE;
+  size_t max_size = DEFAULT_MAX_SIZE;
+  int random_order = 0;
+
+  int i, c;
+  while (1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hs:m:r", long_options, &i);
+
+      if (c == -1)
+	break;
+
+      if (c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch (c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'h':
+	  printf("validate_bench -- read-set validation throughput per kernel\n"
+		 "\n"
+		 "Usage:\n"
+		 "  validate_bench [options...]\n"
+		 "\n"
+		 "Options:\n"
+		 "  -h, --help\n"
+		 "        Print this message\n"
+		 "  -s, --min-size <int>\n"
+		 "        Smallest read set (default=" XSTR(DEFAULT_MIN_SIZE) ")\n"
+		 "  -m, --max-size <int>\n"
+		 "        Largest read set, sizes double from the smallest (default=" XSTR(DEFAULT_MAX_SIZE) ")\n"
+		 "  -r, --random\n"
+		 "        Log the words in random order (default: in address order)\n"
+		 );
+	  exit(0);
+	case 's':
+	  min_size = atol(optarg);
+	  break;
+	case 'm':
+	  max_size = atol(optarg);
+	  break;
+	case 'r':
+	  random_order = 1;
+	  break;
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  assert(min_size > 0 && min_size <= max_size);
+
+  /* the orec table comes with tl2 */
+  sstm_set_algo("tl2");
+  TM_START();
+  TM_THREAD_START();
+
+  seeds = seed_rand();
+  uintptr_t* data = (uintptr_t*) memalign(CACHE_LINE_SIZE, max_size * sizeof(uintptr_t));
+  uintptr_t** words = (uintptr_t**) malloc(max_size * sizeof(uintptr_t*));
+  assert(data != NULL && words != NULL);
+  size_t w;
+  for (w = 0; w < max_size; w++)
+    {
+      data[w] = w;
+      words[w] = &data[w];
+    }
+  if (random_order)
+    {
+      for (w = max_size - 1; w > 0; w--)
+	{
+	  size_t j = xorshf96(&seeds[0], &seeds[1], &seeds[2]) % (w + 1);
+	  uintptr_t* tmp = words[w];
+	  words[w] = words[j];
+	  words[j] = tmp;
+	}
+    }
+
+  printf("# millions of entries validated per second, per kernel\n");
+  printf("#%-9s %-9s", "Size", "Check");
+  int k;
+  for (k = 0; k < SSTM_VALIDATE_NUM; k++)
+    {
+      if (sstm_validates[k]->supported())
+	{
+	  printf(" %-10s", sstm_validates[k]->name);
+	}
+    }
+  printf(" %-8s\n", "Speedup");
+
+  size_t n;
+  for (n = min_size; n <= max_size; n *= 2)
+    {
+      int check;
+      for (check = 0; check < CHECK_NUM; check++)
+	{
+	  fill(check, words, n);
+	  printf("%-10zu %-9s", n, check_names[check]);
+	  double base = 0, best = 0;
+	  for (k = 0; k < SSTM_VALIDATE_NUM; k++)
+	    {
+	      if (!sstm_validates[k]->supported())
+		{
+		  continue;
+		}
+	      double m = measure(sstm_validates[k], check, n);
+	      if (k == SSTM_VALIDATE_SCALAR)
+		{
+		  base = m;
+		}
+	      best = m > best ? m : best;
+	      printf(" %-10.1f", m);
+	    }
+	  printf(" %-8.2f\n", best / base);
+	}
+    }
+
+  free(words);
+  free(data);
+  TM_THREAD_STOP();
+  TM_STOP();
+  return 0;
+}